@@ -36,6 +36,22 @@
 
 /** Types **/
 
+/* Uniform of a shader program, found when it is linked (or when it is first looked up)
+ */
+struct ksgl_uniforminfo {
+
+    /* Name of the uniform */
+    ks_str name;
+
+    /* Location (or -1 if there is no such uniform, so that it is only looked up once) */
+    GLint pos;
+
+    /* Type (i.e. GL_FLOAT_MAT4) and number of elements, or 0 if they are not known */
+    GLenum type;
+    GLint size;
+
+};
+
 /* gl.Shader(src_vert) - OpenGL shader program
  *
  */
@@ -47,8 +63,60 @@ typedef struct ksgl_shader_s {
      */
     int val;
 
+    /* Uniforms which have been found, starting with the active uniforms of the program
+     */
+    int nuniforms;
+    struct ksgl_uniforminfo* uniforms;
+
+    /* Hash table of indices into 'uniforms' (or -1 for empty slots), which has 'ucap' 
+     *   slots (a power of 2), and is kept at most half full
+     */
+    int ucap;
+    int* utab;
+
+    /* Whether the program is still being compiled and linked (i.e. from 'gl.compile_shaders()'), in which 
+     *   case its status hasn't been checked, and 'pend' holds the shaders attached to it
+     */
+    bool pending;
+    int pend[2];
+
+    /* Error from compiling or linking it, which is raised whenever it is used (or NULL if there was none)
+     */
+    ks_str err;
+
+    /* Key in the program binary cache, which it is stored under once it is linked (if 'cache')
+     */
+    bool cache;
+    uint64_t key;
+
 }* ksgl_shader;
 
+/* gl.ShaderTemplate(src_vert, src_frag, includes=none, flags=none) - Shader sources with feature flags, whose
+ *   permutations are compiled when they are requested
+ *
+ */
+typedef struct ksgl_shadertemplate_s {
+    KSO_BASE
+
+    /* Sources, with '#include's resolved
+     */
+    ks_str src_vert, src_frag;
+
+    /* Flags which may be requested (or NULL if any may be)
+     */
+    ks_list flags;
+
+    /* Shaders which have been requested, keyed by the (sorted) flags they were requested with
+     */
+    ks_dict variants;
+
+    /* Shaders keyed by '(src_vert, src_frag)' after the flags were defined, so that flag sets which 
+     *   give the same sources share the same program
+     */
+    ks_dict programs;
+
+}* ksgl_shadertemplate;
+
 
 /* gl.VBO(data='') - OpenGL vertex buffer object
  *
@@ -60,6 +128,15 @@ typedef struct ksgl_vbo_s {
      */
     int val;
 
+    /* Size of the buffer's storage (in bytes), and the usage hint it was created with (GL_STATIC_DRAW, etc)
+     */
+    ks_size_t size;
+    int usage;
+
+    /* Whether the handle may be recycled when this is freed (see 'ksgl_ctx_release()')
+     */
+    bool pool;
+
 }* ksgl_vbo;
 
 /* gl.EBO(data='') - OpenGL element buffer object
@@ -72,9 +149,224 @@ typedef struct ksgl_ebo_s {
      */
     int val;
 
+    /* Size of the buffer's storage (in bytes), and the usage hint it was created with (GL_STATIC_DRAW, etc)
+     */
+    ks_size_t size;
+    int usage;
+
+    /* Type of the indices (GL_UNSIGNED_INT, GL_UNSIGNED_SHORT, or GL_UNSIGNED_BYTE), and the number of them
+     */
+    int idxtype;
+    ks_size_t num;
+
+    /* Whether the indices are triangle strips, separated by the maximum value of 'idxtype' (which should be
+     *   used as the primitive restart index)
+     */
+    bool strip;
+
+    /* Whether the handle may be recycled when this is freed (see 'ksgl_ctx_release()')
+     */
+    bool pool;
+
 }* ksgl_ebo;
 
+/* Member of a 'gl.UBO', which is laid out with the std140 rules
+ */
+struct ksgl_ubofield {
+
+    /* Name of the member */
+    ks_str name;
+
+    /* Offset (in bytes) in the buffer */
+    ks_size_t offset;
+
+    /* Whether it is an integer, and its shape (as in 'ksgl_uniform') */
+    bool isint;
+    int m, n;
+
+};
+
+/* gl.UBO(fields, usage=gl.DYNAMIC_DRAW) - OpenGL uniform buffer object
+ *
+ */
+typedef struct ksgl_ubo_s {
+    KSO_BASE
+
+    /* OpenGL handle for the uniform buffer
+     */
+    int val;
+
+    /* Size of the buffer's storage (in bytes), and the usage hint it was created with (GL_DYNAMIC_DRAW, etc)
+     */
+    ks_size_t size;
+    int usage;
+
+    /* Members, in the order they were given (which must match the uniform block)
+     */
+    int nfields;
+    struct ksgl_ubofield* fields;
+
+    /* Copy of the contents, which values are packed into before being uploaded
+     */
+    unsigned char* data;
+
+    /* Whether the handle may be recycled when this is freed (see 'ksgl_ctx_release()')
+     */
+    bool pool;
+
+}* ksgl_ubo;
+
+/* gl.StreamBuffer(size, nframes=3, target=gl.ARRAY_BUFFER) - ring of mapped buffer regions
+ *
+ * Used for dynamic data that is rewritten every frame. The buffer is split into 'nframes' regions
+ *   of 'size' bytes, and each frame writes into the next region (through a mapped pointer), 
+ *   which is guarded by a fence so that regions still being read by the GPU are never overwritten
+ *
+ */
+typedef struct ksgl_streambuf_s {
+    KSO_BASE
+
+    /* OpenGL handle for the buffer
+     */
+    int val;
+
+    /* Target the buffer is bound to in 'bind()' (GL_ARRAY_BUFFER, etc)
+     */
+    int target;
+
+    /* Size of each region (in bytes), and the number of regions
+     */
+    ks_size_t size;
+    int nframes;
+
+    /* Index of the current region, or -1 if 'next()' hasn't been called
+     */
+    int cur;
+
+    /* Array of fences for each region (NULL if that region is not in use by the GPU)
+     */
+    GLsync* fences;
+
+    /* Persistent mapping of the entire buffer, or NULL if each region is mapped and 
+     *   unmapped every frame (when 'GL_ARB_buffer_storage' is unavailable)
+     */
+    void* pmap;
+
+    /* Whether the current region is mapped (only used when 'pmap == NULL')
+     */
+    bool ismapped;
+
+}* ksgl_streambuf;
+
+/* gl.AsyncRead - Pending asynchronous read of a buffer's contents
+ *
+ * Created by 'VBO.read_async()', which copies into a staging buffer on the GPU, and 
+ *   places a fence after it. The data can be collected later (i.e. the next frame) without stalling
+ *
+ */
+typedef struct ksgl_asyncread_s {
+    KSO_BASE
+
+    /* OpenGL handle for the staging buffer
+     */
+    int val;
+
+    /* Number of bytes being read, and the capacity of the staging buffer
+     */
+    ks_size_t size, cap;
+
+    /* Fence placed after the copy (NULL once it has been waited on), and whether it has been flushed
+     */
+    GLsync fence;
+    bool flushed;
+
+}* ksgl_asyncread;
+
+/* Free range in a 'gl.BufferArena'
+ */
+struct ksgl_arena_block {
+
+    /* Offset and size (in bytes) */
+    ks_size_t offset, size;
+
+};
+
+/* gl.BufferArena(size, stride=1, target=gl.ARRAY_BUFFER, usage=gl.STATIC_DRAW) - sub-allocator for a large buffer
+ *
+ * Many meshes can be stored in a single buffer (and drawn from a single VAO), by carving out 
+ *   ranges. Allocations are aligned to 'stride' (the size of a vertex, or index), so that
+ *   they can be drawn with base-vertex draws
+ *
+ */
+typedef struct ksgl_arena_s {
+    KSO_BASE
+
+    /* OpenGL handle for the buffer
+     */
+    int val;
+
+    /* Target the buffer is bound to in 'bind()', and its usage hint
+     */
+    int target, usage;
+
+    /* Total size (in bytes), and the alignment of allocations (in bytes)
+     */
+    ks_size_t size, stride;
+
+    /* Number of bytes currently allocated
+     */
+    ks_size_t used;
+
+    /* Free ranges, sorted by offset, with adjacent ranges merged
+     */
+    int nfree;
+    struct ksgl_arena_block* free;
+
+    /* Live allocations (not owned; each allocation removes itself when freed)
+     */
+    int nlive;
+    struct ksgl_arena_alloc_s** live;
+
+}* ksgl_arena;
+
+/* gl.ArenaAlloc - range allocated from a 'gl.BufferArena'
+ *
+ * The range is released when this object is freed (or 'BufferArena.free()' is called)
+ *
+ */
+typedef struct ksgl_arena_alloc_s {
+    KSO_BASE
+
+    /* Arena this was allocated from (NULL once released)
+     */
+    ksgl_arena arena;
+
+    /* Offset and size (in bytes) within the arena's buffer
+     */
+    ks_size_t offset, size;
+
+}* ksgl_arena_alloc;
+
+/* Maximum number of attributes in a vertex layout (the minimum 'GL_MAX_VERTEX_ATTRIBS' required by OpenGL)
+ */
+#define KSGL_MAXATTRIB 16
+
+/* Buffer that an attribute of a 'gl.VAO' reads from
+ */
+struct ksgl_vaoattr {
+
+    /* Buffer object (not owned; it is held in 'bufs'), or NULL if it isn't an object */
+    kso buf;
+
+    /* Number of vertices (or instances, if 'inst') it holds, or -1 if the attribute isn't set */
+    ks_cint n;
+    bool inst;
+
+};
+
 /* gl.VAO() - OpenGL vertex array object
+ *
+ * Buffers attached to the VAO are referenced, so that it can be drawn by itself
  *
  */
 typedef struct ksgl_vao_s {
@@ -84,9 +376,270 @@ typedef struct ksgl_vao_s {
      */
     int val;
 
+    /* Vertex buffers currently attached via 'attach()' (each of which is listed once)
+     */
+    ks_list bufs;
+
+    /* Buffer which each attribute reads from
+     */
+    struct ksgl_vaoattr attrs[KSGL_MAXATTRIB];
+
+    /* Element buffer attached via 'attach_ebo()' (or NULL)
+     */
+    ksgl_ebo ebo;
+
+    /* Primitive mode, and the first index and number of indices drawn by 'draw()' (or vertices, 
+     *   if there is no element buffer). If 'count < 0', everything after 'first' is drawn
+     */
+    int mode;
+    ks_cint first, count;
+
+    /* Number of vertices in the attached buffers (or -1 if there are none)
+     */
+    ks_cint nvert;
+
+    /* Number of instances in the attached per-instance buffers (or -1 if there are none)
+     */
+    ks_cint ninst;
+
+    /* Buffer of per-instance matrices, uploaded by 'attach_matrices()' (or -1), and its size (in bytes)
+     */
+    int mats;
+    ks_size_t mats_size;
+
 }* ksgl_vao;
 
 
+/* Single attribute of a vertex layout
+ */
+struct ksgl_vertexattr {
+
+    /* Number of components (1 through 4) */
+    int size;
+
+    /* Type of each component (GL_FLOAT, etc) */
+    GLenum type;
+
+    /* Whether integer components are normalized */
+    bool normalize;
+
+    /* Whether integer components are given to integer inputs (i.e. 'ivec3') as-is, instead of being
+     *   converted to floating point */
+    bool integer;
+
+    /* Offset (in bytes) from the start of the vertex */
+    ks_size_t offset;
+
+};
+
+/* gl.VertexLayout() - Description of the attributes of interleaved vertex data
+ *
+ */
+typedef struct ksgl_vertexlayout_s {
+    KSO_BASE
+
+    /* Number of attributes, and the attributes themselves
+     */
+    int nattr;
+    struct ksgl_vertexattr attr[KSGL_MAXATTRIB];
+
+    /* Size of a single vertex (in bytes)
+     */
+    ks_size_t stride;
+
+}* ksgl_vertexlayout;
+
+
+/* Value of a shader uniform, converted from an object via 'ksgl_uniform_get()'
+ */
+typedef struct {
+
+    /* Whether the value is an integer (in 'i'), otherwise it is floats (in 'f') */
+    bool isint;
+
+    /* Number of rows and columns (a vector has either 'm == 1' or 'n == 1') */
+    int m, n;
+
+    /* Integer value */
+    GLint i;
+
+    /* Float values, dense in row-major order */
+    GLfloat f[16];
+
+} ksgl_uniform;
+
+/* Kinds of commands recorded in a command buffer
+ */
+enum {
+    KSGL_CMD_USE = 0,
+    KSGL_CMD_BIND,
+    KSGL_CMD_TEXTURE,
+    KSGL_CMD_ENABLE,
+    KSGL_CMD_DISABLE,
+    KSGL_CMD_UNIFORM,
+    KSGL_CMD_CLEAR,
+    KSGL_CMD_VIEWPORT,
+    KSGL_CMD_DRAW,
+    KSGL_CMD_DRAW_ARRAYS,
+    KSGL_CMD_DRAW_ELEMENTS,
+};
+
+/* Single recorded command
+ */
+struct ksgl_cmd {
+
+    /* Kind of command (KSGL_CMD_*) */
+    int kind;
+
+    /* Arguments, which depend on the kind of command (objects are stored as indices into 'objs') */
+    GLint args[4];
+
+};
+
+/* gl.CommandBuffer() - Recorded sequence of OpenGL calls, which can be replayed in a single call
+ *
+ */
+typedef struct ksgl_cmdbuf_s {
+    KSO_BASE
+
+    /* Recorded commands
+     */
+    int ncmds;
+    struct ksgl_cmd* cmds;
+
+    /* Values of uniforms, which may be patched between replays
+     */
+    int nuniforms;
+    ksgl_uniform* uniforms;
+
+    /* Objects used by the commands, which are kept alive
+     */
+    ks_list objs;
+
+}* ksgl_cmdbuf;
+
+
+/* Item submitted to a render queue
+ */
+struct ksgl_rq_item {
+
+    /* Sort key (see 'RenderQueue.push()') */
+    ks_uint key;
+
+    /* Pipeline (or NULL, if only a shader was given), shader, and VAO to draw with (references are held in 'objs') */
+    struct ksgl_pipeline_s* pipeline;
+    ksgl_shader shader;
+    ksgl_vao vao;
+
+    /* Number of instances to draw (or -1 for all of them) */
+    ks_cint instances;
+
+    /* Range of textures (in 'texs'), which are bound to units 0, 1, ... */
+    int tex, ntex;
+
+    /* Range of uniforms (in 'unis') */
+    int uni, nuni;
+
+};
+
+/* Uniform set by a render queue item
+ */
+struct ksgl_rq_uniform {
+
+    /* Location in the item's shader */
+    int pos;
+
+    /* Value to set */
+    ksgl_uniform val;
+
+};
+
+/* gl.RenderQueue(transparent=false) - Queue of draws, which are sorted to minimize state changes
+ *
+ */
+typedef struct ksgl_renderqueue_s {
+    KSO_BASE
+
+    /* Whether items are drawn back-to-front (for transparent objects), otherwise they are grouped
+     *   by state and drawn front-to-back
+     */
+    bool transparent;
+
+    /* Items which have been submitted
+     */
+    int nitems;
+    struct ksgl_rq_item* items;
+
+    /* Texture handles and uniforms used by the items
+     */
+    int ntexs;
+    GLuint* texs;
+    int nunis;
+    struct ksgl_rq_uniform* unis;
+
+    /* Objects used by the items, which are kept alive until the queue is cleared
+     */
+    ks_list objs;
+
+}* ksgl_renderqueue;
+
+
+/* gl.Pipeline(shader=none, ...) - Bundle of a shader and the fixed-function state used to draw with it
+ *
+ */
+typedef struct ksgl_pipeline_s {
+    KSO_BASE
+
+    /* Unique id (i.e. for sorting by pipeline) */
+    int id;
+
+    /* Shader to use (or NULL to leave the current program) */
+    ksgl_shader shader;
+
+    /* Depth testing, writing, and comparison */
+    bool depth_test, depth_write;
+    GLenum depth_func;
+
+    /* Blending, and the source and destination factors */
+    bool blend;
+    GLenum blend_src, blend_dst;
+
+    /* Face to cull (or 0 for no culling) */
+    GLenum cull;
+
+    /* Polygon mode (for both faces) */
+    GLenum polygon_mode;
+
+    /* Viewport, if 'hasviewport' (otherwise it is left alone) */
+    bool hasviewport;
+    GLint viewport[4];
+
+}* ksgl_pipeline;
+
+/* gl.RenderPass(target=0, ...) - Target framebuffer and the values it is cleared to
+ *
+ */
+typedef struct ksgl_renderpass_s {
+    KSO_BASE
+
+    /* Framebuffer to render to (0 is the default framebuffer) */
+    GLuint target;
+
+    /* Color to clear to, if 'hascolor' */
+    bool hascolor;
+    GLfloat color[4];
+
+    /* Depth to clear to, if 'hasdepth' */
+    bool hasdepth;
+    GLdouble depth;
+
+    /* Viewport, if 'hasviewport' (otherwise it is left alone) */
+    bool hasviewport;
+    GLint viewport[4];
+
+}* ksgl_renderpass;
+
+
 /* gl.texture2d() - OpenGL 2D texture
  *
  */
@@ -97,23 +650,462 @@ typedef struct ksgl_texture2d_s {
      */
     int val;
 
+    /* Size and internal format of the texture's storage (width < 0 if it has no storage)
+     */
+    int width, height, internalformat;
+
 }* ksgl_texture2d;
 
 
 
 
+/* Contiguous bytes of some object, ready to be uploaded to OpenGL
+ *
+ * Created via 'ksgl_buf_get()', and must be released via 'ksgl_buf_done()'
+ */
+typedef struct {
+
+    /* Start of the data, and its length (in bytes) */
+    void* data;
+    ks_size_t len;
+
+    /* Object which owns 'data' (or NULL), which a reference is held to */
+    kso ref;
+
+    /* Temporary storage that 'data' was gathered into (or NULL), allocated via 'ks_malloc()' */
+    void* tmp;
+
+} ksgl_buf;
+
+
+/* Global statistics, returned by 'gl.stats()'
+ */
+struct ksgl_stats_s {
+
+    /* Number of uploads, total bytes uploaded, and bytes which had to be copied 
+     *   on the CPU before uploading
+     */
+    ks_size_t n_upload, sz_upload, sz_upload_copied;
+
+    /* Number of times the CPU had to wait on a fence for the GPU
+     */
+    ks_size_t n_sync_stall;
+
+    /* Number of handles generated, recycled, and deleted, and the number of batched delete calls
+     */
+    ks_size_t n_gen, n_recycle, n_delete, n_delete_batch;
+
+    /* Number of binds and state changes which were made, and which were skipped because they
+     *   were already current
+     */
+    ks_size_t n_state_change, n_state_skip;
+
+    /* Number of shader programs which were loaded from the program binary cache, and which had to be compiled
+     *   (because there was no valid entry)
+     */
+    ks_size_t n_shader_hit, n_shader_miss;
+
+};
+
+extern struct ksgl_stats_s ksgl_stats;
+
+
+/* Kinds of OpenGL objects whose handles are managed by the context
+ */
+enum {
+    KSGL_OBJ_BUFFER = 0,
+    KSGL_OBJ_TEXTURE,
+    KSGL_OBJ_VAO,
+
+    KSGL_OBJ__N
+};
+
+/* Maximum number of recycled handles kept for each kind of object
+ */
+#define KSGL_POOL_MAX 64
+
+/* Number of frames a recycled handle is kept before being deleted
+ */
+#define KSGL_POOL_FRAMES 8
+
+/* Number of handles generated at once
+ */
+#define KSGL_GEN_BATCH 16
+
+/* Maximum number of texture units tracked (units past this are not supported)
+ */
+#define KSGL_MAXUNITS 16
+
+/* Maximum number of capabilities (i.e. GL_DEPTH_TEST) tracked
+ */
+#define KSGL_MAXCAPS 32
+
+/* Handle value for state which is unknown (i.e. after 'ksgl_ctx_invalidate()')
+ */
+#define KSGL_UNKNOWN ((GLuint)-1)
+
+/* Recycled handle, which still has storage allocated
+ */
+struct ksgl_pooled {
+
+    /* OpenGL handle */
+    GLuint val;
+
+    /* Description of the storage, which must match exactly for it to be reused 
+     *   (i.e. size and usage for buffers, or width, height, and format for textures)
+     */
+    ks_size_t key[3];
+
+    /* Frame it was released on */
+    ks_size_t frame;
+
+};
+
+/* State for the OpenGL context
+ *
+ * Objects may be garbage collected at any time (even when the context is not current), so
+ *   handles are never deleted immediately, but queued and deleted in batches at the end of a 
+ *   frame. Handles of buffers and textures are kept for a few frames, so that objects created
+ *   with the same storage can reuse them without any reallocation
+ *
+ * gl3w is initialized once for the module, so a single context is assumed
+ */
+struct ksgl_ctx_s {
+
+    /* Current frame number (incremented by 'ksgl_ctx_flush()') */
+    ks_size_t frame;
+
+    /* Generated handles which haven't been used yet */
+    int nspare[KSGL_OBJ__N];
+    GLuint spare[KSGL_OBJ__N][KSGL_GEN_BATCH];
+
+    /* Handles queued for deletion */
+    int ndel[KSGL_OBJ__N];
+    GLuint* del[KSGL_OBJ__N];
+
+    /* Recycled handles */
+    int npool[KSGL_OBJ__N];
+    struct ksgl_pooled pool[KSGL_OBJ__N][KSGL_POOL_MAX];
+
+    /* Currently bound VAO, and whether it was only bound to draw it (in which case it is
+     *   unbound before anything would modify it)
+     */
+    GLuint vao;
+    bool vao_draw;
+
+    /* Current program, and the buffer bound to GL_ARRAY_BUFFER */
+    GLuint program, arraybuf;
+
+    /* Active texture unit (or -1 if unknown), and the 2D texture bound to each unit */
+    int unit;
+    GLuint tex[KSGL_MAXUNITS];
+
+    /* Capabilities whose state is known, and whether they are enabled */
+    int ncaps;
+    struct {
+        GLenum cap;
+        bool on;
+    } caps[KSGL_MAXCAPS];
+
+    /* Primitive restart index, if 'hasrestart', and whether primitive restart was only enabled to draw
+     *   strips (in which case it is disabled before other indexed draws)
+     */
+    bool hasrestart, autorestart;
+    GLuint restart;
+
+    /* Viewport, if 'hasviewport' */
+    bool hasviewport;
+    GLint viewport[4];
+
+    /* Bound framebuffer, depth comparison, blend factors, culled face, and polygon mode (each of 
+     *   which is KSGL_UNKNOWN if it is not known)
+     */
+    GLuint framebuffer;
+    GLenum depthfunc, blendsrc, blenddst, cullface, polygonmode;
+
+    /* Whether depth writes are enabled (or -1 if it is not known) */
+    int depthmask;
+
+    /* Clear color and depth, if 'hasclearcolor' and 'hascleardepth' */
+    bool hasclearcolor, hascleardepth;
+    GLfloat clearcolor[4];
+    GLdouble cleardepth;
+
+};
+
+extern struct ksgl_ctx_s ksgl_ctx;
+
+
 /** Functions **/
 
 /* Checks the last error, and if there has been an error, throws an exception and returns false
  */
 bool ksgl_check();
 
+/* Convert 'obj' (an integer, or a sequence of integers) into a shape
+ * 'shape' should have room for 'NX_MAXRANK' values
+ */
+bool ksgl_getshape(kso obj, int* rank, ks_size_t* shape);
+
+/* Returns the size (in bytes) of an index type (GL_UNSIGNED_INT, etc), or 0 if it is not an index type
+ */
+int ksgl_idxsize(int type);
+
+/* Returns the primitive restart index of an index type, which is its maximum value
+ */
+GLuint ksgl_idxrestart(int type);
+
+/* Returns whether the current context supports OpenGL version 'major.minor'
+ */
+bool ksgl_hasver(int major, int minor);
+
+/* Returns whether the current context supports the extension 'name' (i.e. "GL_ARB_buffer_storage")
+ */
+bool ksgl_hasext(const char* name);
+
+/* Waits for '*fence' to be signaled, then deletes it and sets it to NULL. If '*fence' is NULL, 
+ *   returns immediately
+ *
+ * If the wait fails, an error is thrown and false is returned
+ */
+bool ksgl_fence_wait(GLsync* fence);
+
+/* Turn 'obj' into contiguous bytes for uploading, storing in 'out'
+ *
+ * Dense 'nx.array's (and views) and 'bytes' are used in place, without a copy. Strided arrays
+ *   are gathered in a single pass into temporary storage, and anything else is converted via 'kso_bytes()'
+ * 
+ * 'none' is treated as empty data
+ */
+bool ksgl_buf_get(kso obj, ksgl_buf* out);
+
+/* Turn 'obj' (an array, or anything convertible to one) into contiguous elements of 'dtype', storing in 'out'
+ *
+ * Unlike 'ksgl_buf_get()', this is meant for arguments (i.e. counts and offsets), so it is not counted
+ *   as an upload
+ */
+bool ksgl_buf_getas(kso obj, nx_dtype dtype, ksgl_buf* out);
+
+/* Release resources held by 'buf'
+ */
+void ksgl_buf_done(ksgl_buf* buf);
+
+/* Get the array value of 'obj', which must be an 'nx.array' or a view of one (no conversion is done,
+ *   so that it may be written to)
+ */
+bool ksgl_getnx(kso obj, nx_t* out);
+
+/* Read the contents of the buffer bound to 'target', starting at byte 'offset', into 'out'
+ *
+ * If 'out' is dense, the data is read directly into it without any allocation
+ */
+bool ksgl_read_into(int target, ks_size_t offset, nx_t out);
+
+/* Returns whether 'val' is stored densely in row-major order
+ */
+bool ksgl_isdense(nx_t val);
+
+/* Returns the number of bytes taken up by the elements of 'val'
+ */
+ks_size_t ksgl_nbytes(nx_t val);
+
+
+/* Start an asynchronous read of 'size' bytes from buffer 'buf' (an OpenGL handle), starting at 'offset'
+ *
+ * If 'reuse' is given, its staging buffer is reused (and a new reference to it is returned)
+ */
+ksgl_asyncread ksgl_asyncread_start(int buf, ks_size_t offset, ks_size_t size, ksgl_asyncread reuse);
+
+/* Allocate 'size' bytes from 'arena'
+ *
+ * Existing allocations are never moved, so this throws a 'SizeError' if no single free range is large
+ *   enough (even if there are enough free bytes in total)
+ */
+ksgl_arena_alloc ksgl_arena_take(ksgl_arena arena, ks_size_t size);
+
+/* Return the range of 'alloc' to its arena (does nothing if it has already been released)
+ */
+void ksgl_arena_release(ksgl_arena_alloc alloc);
+
+/* Get the OpenGL handle of a vertex buffer 'obj' (a 'gl.VBO' or 'gl.ArenaAlloc'), and the byte offset and size of its data
+ */
+bool ksgl_getbuffer(kso obj, int* val, ks_size_t* offset, ks_size_t* size);
+
+/* Set the attribute pointers (starting at index 'base') of vertex array 'vao' to read 'layout' from
+ *   buffer 'vbo', starting at byte 'offset', and enable them
+ *
+ * If 'divisor > 0', the attributes advance once per 'divisor' instances, instead of once per vertex
+ *
+ * 'vao' is left bound
+ */
+bool ksgl_vertexlayout_apply(ksgl_vertexlayout layout, int vao, int vbo, int base, ks_size_t offset, int divisor);
+
+/* Attach 'vbo' (a 'gl.VBO' or 'gl.ArenaAlloc') to 'self', starting at byte 'offset', as described by 'layout' 
+ *   (per-instance, if 'divisor > 0'). A reference to 'vbo' is held while any attribute reads from it
+ */
+bool ksgl_vao_attach(ksgl_vao self, kso vbo, ksgl_vertexlayout layout, int base, ks_size_t offset, int divisor);
+
+/* Draw 'self' (as 'VAO.draw()' does), drawing 'instances' instances (or all the attached instances, if 'instances < 0')
+ */
+bool ksgl_vao_draw(ksgl_vao self, ks_cint instances);
+
+/* Apply 'self' (as 'Pipeline.apply()' does), only changing the state which differs from the current state
+ */
+bool ksgl_pipeline_apply(ksgl_pipeline self);
+
+/* Begin 'self' (as 'RenderPass.begin()' does), binding its target and clearing it
+ */
+void ksgl_renderpass_begin(ksgl_renderpass self);
+
+/* Set the directory of the program binary cache (or disable it, if 'dir' is NULL). The directory must exist
+ */
+void ksgl_shader_cachedir(const char* dir);
+
+/* Start compiling and linking a shader (or load it from the program binary cache), without waiting for the
+ *   driver to finish. Errors from compiling or linking are thrown by 'ksgl_shader_finish()'
+ */
+ksgl_shader ksgl_shader_submit(ks_str src_vert, ks_str src_frag);
+
+/* Wait for 'self' to be compiled and linked (if it is pending), throwing an error if either failed. This 
+ *   must be called before the program is used
+ */
+bool ksgl_shader_finish(ksgl_shader self);
+
+/* Get the location of the uniform 'name' of 'self', from its table of uniforms. If it is not in the 
+ *   table, it is looked up (once) and added. Throws an error and returns -1 if there is no such uniform
+ */
+int ksgl_shader_uniformloc(ksgl_shader self, ks_str name);
+
+/* Convert 'val' (an integer, or a float, vector, or matrix) into a uniform value
+ */
+bool ksgl_uniform_get(kso val, ksgl_uniform* out);
+
+/* Set the uniform at location 'pos' of the current program to 'u'
+ */
+void ksgl_uniform_set(int pos, ksgl_uniform* u);
+
+/* Set the uniform at location 'pos' of the current program to 'val' (as 'ksgl_uniform_get()' converts it)
+ *
+ * Dense arrays of 'nx.float' are given to OpenGL directly, without being converted or copied
+ */
+bool ksgl_uniform_setobj(int pos, kso val);
+
+/* Get a new handle for an object of 'kind' (KSGL_OBJ_*), without any storage
+ */
+GLuint ksgl_ctx_gen(int kind);
+
+/* Take a recycled handle for an object of 'kind' whose storage matches 'key', returning whether one was found
+ *
+ * Buffers (whose key is '{ size, usage, 0 }') are given new storage (orphaning the old storage), so that draws
+ *   which are still using the old storage are unaffected. The handle itself is the same, though, so anything
+ *   which still refers to it (i.e. a VAO set up through raw calls) sees the new contents. Objects which have
+ *   been bound outside of the paths which hold a reference to them should not be released with a key
+ */
+bool ksgl_ctx_take(int kind, ks_size_t* key, GLuint* val);
+
+/* Release a handle for an object of 'kind'. If 'key' is given, the handle may be recycled, 
+ *   otherwise it is queued for deletion
+ *
+ * Buffers which were left bound where untracked state may capture them (i.e. by 'bind()', which a raw
+ *   'gl.VAO.attrib()' or uniform binding point can refer to) must not be given a key, since the handle
+ *   would then refer to another object's data. Their 'pool' field is cleared when that happens
+ *
+ * This never calls OpenGL, so it is safe to call when no context is current
+ */
+void ksgl_ctx_release(int kind, GLuint val, ks_size_t* key);
+
+/* Bind vertex array 'val' (if it is not already bound). 'draw' should be true if it is only being bound for drawing
+ */
+void ksgl_ctx_bindvao(GLuint val, bool draw);
+
+/* Bind buffer 'val' to 'target' (if it is not already bound). Only GL_ARRAY_BUFFER is cached, so other 
+ *   targets are always bound
+ */
+void ksgl_ctx_bindbuf(GLenum target, GLuint val);
+
+/* Use program 'val' (if it is not already current)
+ */
+void ksgl_ctx_useprogram(GLuint val);
+
+/* Bind 2D texture 'val' to texture unit 'unit' (or the active unit, if 'unit < 0'), if it is not already bound.
+ *   This also makes 'unit' the active unit
+ */
+void ksgl_ctx_bindtex(int unit, GLuint val);
+
+/* Enable (or disable) capability 'cap', if it is not already
+ */
+void ksgl_ctx_enable(GLenum cap, bool on);
+
+/* Enable primitive restart, with index 'idx' (if it is not already)
+ */
+void ksgl_ctx_restart(GLuint idx);
+
+/* Disable primitive restart, if it was enabled by 'ksgl_ctx_restart()' (and not explicitly), which should
+ *   be called before indexed draws which aren't strips, so that indices equal to the restart index are drawn
+ */
+void ksgl_ctx_norestart();
+
+/* Set the viewport, if it is not already
+ */
+void ksgl_ctx_viewport(GLint x, GLint y, GLint w, GLint h);
+
+/* Bind framebuffer 'val' (if it is not already bound)
+ */
+void ksgl_ctx_bindfbo(GLuint val);
+
+/* Set the depth comparison function, if it is not already
+ */
+void ksgl_ctx_depthfunc(GLenum func);
+
+/* Enable (or disable) depth writes, if they are not already
+ */
+void ksgl_ctx_depthmask(bool on);
+
+/* Set the blend factors, if they are not already
+ */
+void ksgl_ctx_blendfunc(GLenum src, GLenum dst);
+
+/* Set the face which is culled, if it is not already
+ */
+void ksgl_ctx_cullface(GLenum face);
+
+/* Set the polygon mode of both faces, if it is not already
+ */
+void ksgl_ctx_polygonmode(GLenum mode);
+
+/* Set the clear color, if it is not already
+ */
+void ksgl_ctx_clearcolor(GLfloat r, GLfloat g, GLfloat b, GLfloat a);
+
+/* Set the clear depth, if it is not already
+ */
+void ksgl_ctx_cleardepth(GLdouble depth);
+
+/* Forget all cached state, so that the next bind or state change is always made. This must be called
+ *   after OpenGL is used by anything other than these bindings (i.e. another library)
+ */
+void ksgl_ctx_invalidate();
+
+/* Delete all queued handles (in batches), and expire old recycled handles. This should be
+ *   called once per frame (it is called by 'gl.glfw.Window.swap()')
+ */
+void ksgl_ctx_flush();
+
+/* Convert 'ntri' triangles (3 indices each, with consistent winding) in 'idx' into triangle strips, which 
+ *   are separated by 'restart'. Returns an array allocated with 'ks_malloc()', and sets '*nout' to its length
+ */
+nx_u32* ksgl_stripify(const nx_u32* idx, ks_size_t ntri, nx_u32 restart, ks_size_t* nout);
 
 /* Convert arguments to a color (RGBA)
  * 'out' should store '4' values
  */
 bool ksgl_getcolor(int nargs, kso* args, ks_cfloat* out);
 
+/* Convert 'obj' (a sequence of '(x, y, w, h)') to a rectangle (i.e. a viewport)
+ * 'out' should store '4' values
+ */
+bool ksgl_getrect(kso obj, GLint* out);
+
 
 
 #ifdef KSGL_GLFW
@@ -201,9 +1193,20 @@ typedef struct ksgl_ai_scene_s {
 
 ks_type
     ksglt_vbo,
+    ksglt_ubo,
     ksglt_ebo,
+    ksglt_streambuf,
+    ksglt_asyncread,
+    ksglt_arena,
+    ksglt_arena_alloc,
     ksglt_vao,
+    ksglt_vertexlayout,
+    ksglt_cmdbuf,
+    ksglt_renderqueue,
+    ksglt_pipeline,
+    ksglt_renderpass,
     ksglt_shader,
+    ksglt_shadertemplate,
     ksglt_texture1d,
     ksglt_texture2d,
     ksglt_texture3d,
@@ -225,10 +1228,21 @@ ks_module _ksgl_util();
 ks_module _ksgl_ai();
 
 void _ksgl_shader();
+void _ksgl_shadertemplate();
 void _ksgl_texture2d();
 void _ksgl_vbo();
+void _ksgl_ubo();
 void _ksgl_vao();
+void _ksgl_vertexlayout();
+void _ksgl_cmdbuf();
+void _ksgl_renderqueue();
+void _ksgl_pipeline();
+void _ksgl_renderpass();
 void _ksgl_ebo();
+void _ksgl_streambuf();
+void _ksgl_asyncread();
+void _ksgl_arena();
+void _ksgl_arena_alloc();
 
 void _ksgl_glfw_monitor();
 void _ksgl_glfw_window();
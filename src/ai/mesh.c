@@ -76,6 +76,28 @@ static KS_TFUNC(T, getattr) {
         ks_free(rdata);
         return (kso)res;
 
+    } else if (ks_str_eq_c(attr, "strip", 5)) {
+        nx_u32* rdata = ks_smalloc(sizeof(*rdata) * 3 * self->val->mNumFaces);
+        ks_size_t n = 0;
+        int i;
+        for (i = 0; i < self->val->mNumFaces; ++i) {
+            if (self->val->mFaces[i].mNumIndices != 3) continue;
+            rdata[n++] = self->val->mFaces[i].mIndices[0];
+            rdata[n++] = self->val->mFaces[i].mIndices[1];
+            rdata[n++] = self->val->mFaces[i].mIndices[2];
+        }
+
+        ks_size_t nout;
+        nx_u32* sdata = ksgl_stripify(rdata, n / 3, ksgl_idxrestart(GL_UNSIGNED_INT), &nout);
+        ks_free(rdata);
+        if (!sdata) {
+            return NULL;
+        }
+
+        nx_array res = nx_array_newc(nxt_array, sdata, nxd_u32, 1, (ks_size_t[]){ nout }, NULL);
+        ks_free(sdata);
+        return (kso)res;
+
     }
 
 
@@ -0,0 +1,374 @@
+/* arena.c - gl.BufferArena type
+ *
+ * @author: Cade Brown <cade@kscript.org>
+ */
+#include <ksgl.h>
+
+#define T_NAME M_NAME ".BufferArena"
+
+
+/* Internals */
+
+/* Add a free range, merging with its neighbors */
+static void my_free_add(ksgl_arena self, ks_size_t offset, ks_size_t size) {
+    /* Find insertion point */
+    int i = 0;
+    while (i < self->nfree && self->free[i].offset < offset) i++;
+
+    bool mprev = i > 0 && self->free[i - 1].offset + self->free[i - 1].size == offset;
+    bool mnext = i < self->nfree && offset + size == self->free[i].offset;
+
+    if (mprev && mnext) {
+        /* Bridges two ranges */
+        self->free[i - 1].size += size + self->free[i].size;
+        memmove(&self->free[i], &self->free[i + 1], sizeof(*self->free) * (self->nfree - i - 1));
+        self->nfree--;
+    } else if (mprev) {
+        self->free[i - 1].size += size;
+    } else if (mnext) {
+        self->free[i].offset = offset;
+        self->free[i].size += size;
+    } else {
+        self->free = ks_zrealloc(self->free, sizeof(*self->free), self->nfree + 1);
+        memmove(&self->free[i + 1], &self->free[i], sizeof(*self->free) * (self->nfree - i));
+        self->free[i].offset = offset;
+        self->free[i].size = size;
+        self->nfree++;
+    }
+}
+
+/* Take 'size' bytes from the first free range that fits, returning the offset (or -1 if none fit) */
+static ks_ssize_t my_free_take(ksgl_arena self, ks_size_t size) {
+    int i;
+    for (i = 0; i < self->nfree; ++i) {
+        if (self->free[i].size >= size) {
+            ks_ssize_t res = self->free[i].offset;
+            self->free[i].offset += size;
+            self->free[i].size -= size;
+            if (self->free[i].size == 0) {
+                memmove(&self->free[i], &self->free[i + 1], sizeof(*self->free) * (self->nfree - i - 1));
+                self->nfree--;
+            }
+            return res;
+        }
+    }
+
+    return -1;
+}
+
+/* Compare allocations by offset */
+static int my_cmp_offset(const void* A, const void* B) {
+    ksgl_arena_alloc a = *(ksgl_arena_alloc*)A, b = *(ksgl_arena_alloc*)B;
+    return a->offset < b->offset ? -1 : (a->offset > b->offset ? 1 : 0);
+}
+
+/* Move all live allocations to the start of the buffer, so there is a single free range at the end
+ *
+ * Copies within the same buffer can't overlap, so the live data is packed into a temporary
+ *   buffer, and then copied back in a single call (which keeps the buffer handle the same)
+ */
+static bool my_defrag(ksgl_arena self, ks_size_t* moved) {
+    *moved = 0;
+    if (self->nfree == 0 || (self->nfree == 1 && self->free[0].offset + self->free[0].size == self->size)) {
+        /* Already compact */
+        return true;
+    }
+
+    qsort(self->live, self->nlive, sizeof(*self->live), my_cmp_offset);
+
+    GLuint tmp;
+    glGenBuffers(1, &tmp);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, tmp);
+    glBufferData(GL_COPY_WRITE_BUFFER, self->used, NULL, GL_STREAM_COPY);
+    glBindBuffer(GL_COPY_READ_BUFFER, self->val);
+    if (!ksgl_check()) {
+        glDeleteBuffers(1, &tmp);
+        return false;
+    }
+
+    /* Pack, copying runs of adjacent allocations at once */
+    ks_size_t pos = 0;
+    int i = 0;
+    while (i < self->nlive) {
+        ks_size_t src = self->live[i]->offset, len = 0;
+        int j = i;
+        while (j < self->nlive && self->live[j]->offset == src + len) {
+            self->live[j]->offset = pos + len;
+            len += self->live[j]->size;
+            j++;
+        }
+
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, src, pos, len);
+        if (src != pos) *moved += len;
+        pos += len;
+        i = j;
+    }
+
+    /* Copy back */
+    glBindBuffer(GL_COPY_READ_BUFFER, tmp);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, self->val);
+    if (pos > 0) glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, pos);
+    glDeleteBuffers(1, &tmp);
+    if (!ksgl_check()) {
+        return false;
+    }
+
+    /* Now, there is a single free range */
+    self->nfree = 0;
+    if (pos < self->size) my_free_add(self, pos, self->size - pos);
+
+    return true;
+}
+
+
+/* C-API */
+
+ksgl_arena_alloc ksgl_arena_take(ksgl_arena arena, ks_size_t size) {
+    /* Round up to a multiple of the stride (and make sure empty allocations still get a unique offset) */
+    if (size == 0) size = arena->stride;
+    size = ((size + arena->stride - 1) / arena->stride) * arena->stride;
+
+    ks_ssize_t off = my_free_take(arena, size);
+    if (off < 0 && arena->size - arena->used >= size) {
+        /* There is enough space, but it is fragmented. Compacting would move the other allocations (whose
+         *   offsets may already be in use), so that is left to an explicit 'defrag()'
+         */
+        KS_THROW(kst_SizeError, "Arena is fragmented (requested %i bytes, and %i bytes are free, but not in a single range). Call 'defrag()' to compact it", (int)size, (int)(arena->size - arena->used));
+        return NULL;
+    } else if (off < 0) {
+        KS_THROW(kst_SizeError, "Arena is full (requested %i bytes, but only %i of %i bytes are free)", (int)size, (int)(arena->size - arena->used), (int)arena->size);
+        return NULL;
+    }
+
+    ksgl_arena_alloc res = KSO_NEW(ksgl_arena_alloc, ksglt_arena_alloc);
+    KS_INCREF(arena);
+    res->arena = arena;
+    res->offset = off;
+    res->size = size;
+
+    arena->used += size;
+    arena->live = ks_zrealloc(arena->live, sizeof(*arena->live), arena->nlive + 1);
+    arena->live[arena->nlive++] = res;
+
+    return res;
+}
+
+void ksgl_arena_release(ksgl_arena_alloc alloc) {
+    ksgl_arena arena = alloc->arena;
+    if (!arena) {
+        return;
+    }
+
+    my_free_add(arena, alloc->offset, alloc->size);
+    arena->used -= alloc->size;
+
+    int i;
+    for (i = 0; i < arena->nlive; ++i) {
+        if (arena->live[i] == alloc) {
+            arena->live[i] = arena->live[--arena->nlive];
+            break;
+        }
+    }
+
+    alloc->arena = NULL;
+    KS_DECREF(arena);
+}
+
+
+/* Type Functions */
+
+static KS_TFUNC(T, free) {
+    ksgl_arena self;
+    KS_ARGS("self:*", &self, ksglt_arena);
+
+    if (self->val >= 0) ksgl_ctx_release(KSGL_OBJ_BUFFER, self->val, NULL);
+    ks_free(self->free);
+    ks_free(self->live);
+
+    KSO_DEL(self);
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, init) {
+    ksgl_arena self;
+    ks_cint size, stride = 1, target = GL_ARRAY_BUFFER, usage = GL_STATIC_DRAW;
+    KS_ARGS("self:* size:cint ?stride:cint ?target:cint ?usage:cint", &self, ksglt_arena, &size, &stride, &target, &usage);
+
+    self->val = -1;
+    self->nfree = 0;
+    self->free = NULL;
+    self->nlive = 0;
+    self->live = NULL;
+    self->used = 0;
+
+    if (size <= 0) {
+        KS_THROW(kst_SizeError, "'size' must be positive, but got %i", (int)size);
+        return NULL;
+    }
+    if (stride <= 0) {
+        KS_THROW(kst_SizeError, "'stride' must be positive, but got %i", (int)stride);
+        return NULL;
+    }
+
+    /* Round down to a whole number of elements */
+    self->stride = stride;
+    self->size = (size / stride) * stride;
+    self->target = target;
+    self->usage = usage;
+
+    /* Create buffer object */
+    self->val = ksgl_ctx_gen(KSGL_OBJ_BUFFER);
+
+    /* Bind to the copy target, so that we don't modify any VAO state */
+    glBindBuffer(GL_COPY_WRITE_BUFFER, self->val);
+    glBufferData(GL_COPY_WRITE_BUFFER, self->size, NULL, usage);
+    if (!ksgl_check()) {
+        return NULL;
+    }
+
+    my_free_add(self, 0, self->size);
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, getattr) {
+    ksgl_arena self;
+    ks_str attr;
+    KS_ARGS("self:* attr:*", &self, ksglt_arena, &attr, kst_str);
+
+    if (ks_str_eq_c(attr, "size", 4)) {
+        return (kso)ks_int_new(self->size);
+    } else if (ks_str_eq_c(attr, "stride", 6)) {
+        return (kso)ks_int_new(self->stride);
+    } else if (ks_str_eq_c(attr, "used", 4)) {
+        return (kso)ks_int_new(self->used);
+    } else if (ks_str_eq_c(attr, "stats", 5)) {
+        ks_size_t largest = 0;
+        int i;
+        for (i = 0; i < self->nfree; ++i) {
+            if (self->free[i].size > largest) largest = self->free[i].size;
+        }
+
+        return (kso)ks_dict_new(KS_IKV(
+            {"size",                   (kso)ks_int_new(self->size)},
+            {"used",                   (kso)ks_int_new(self->used)},
+            {"free",                   (kso)ks_int_new(self->size - self->used)},
+            {"occupancy",              (kso)ks_float_new((ks_cfloat)self->used / self->size)},
+            {"nalloc",                 (kso)ks_int_new(self->nlive)},
+            {"nfree_blocks",           (kso)ks_int_new(self->nfree)},
+            {"largest_free",           (kso)ks_int_new(largest)},
+        ));
+    }
+
+    KS_THROW_ATTR(self, attr);
+    return NULL;
+}
+
+static KS_TFUNC(T, bind) {
+    ksgl_arena self;
+    KS_ARGS("self:*", &self, ksglt_arena);
+
+    ksgl_ctx_bindbuf(self->target, self->val);
+    if (!ksgl_check()) {
+        return NULL;
+    }
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, unbind) {
+    ksgl_arena self;
+    KS_ARGS("self:*", &self, ksglt_arena);
+
+    ksgl_ctx_bindbuf(self->target, 0);
+    if (!ksgl_check()) {
+        return NULL;
+    }
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, alloc) {
+    ksgl_arena self;
+    kso data = KSO_NONE;
+    ks_cint size = -1;
+    KS_ARGS("self:* ?data ?size:cint", &self, ksglt_arena, &data, &size);
+
+    /* Get the raw data (without copying, if possible) */
+    ksgl_buf buf;
+    if (!ksgl_buf_get(data, &buf)) {
+        return NULL;
+    }
+
+    if (size < 0) size = buf.len;
+    if (buf.len > size) {
+        KS_THROW(kst_SizeError, "Data is %i bytes, but only %i bytes were requested", (int)buf.len, (int)size);
+        ksgl_buf_done(&buf);
+        return NULL;
+    }
+
+    ksgl_arena_alloc res = ksgl_arena_take(self, size);
+    if (!res) {
+        ksgl_buf_done(&buf);
+        return NULL;
+    }
+
+    if (buf.len > 0) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, self->val);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, res->offset, buf.len, buf.data);
+    }
+    ksgl_buf_done(&buf);
+    if (!ksgl_check()) {
+        KS_DECREF(res);
+        return NULL;
+    }
+
+    return (kso)res;
+}
+
+static KS_TFUNC(T, free_) {
+    ksgl_arena self;
+    ksgl_arena_alloc alloc;
+    KS_ARGS("self:* alloc:*", &self, ksglt_arena, &alloc, ksglt_arena_alloc);
+
+    if (alloc->arena != self) {
+        KS_THROW(kst_Error, "Allocation does not belong to this arena (or was already freed)");
+        return NULL;
+    }
+
+    ksgl_arena_release(alloc);
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, defrag) {
+    ksgl_arena self;
+    KS_ARGS("self:*", &self, ksglt_arena);
+
+    ks_size_t moved;
+    if (!my_defrag(self, &moved)) {
+        return NULL;
+    }
+
+    return (kso)ks_int_new(moved);
+}
+
+
+/* Export */
+
+ks_type ksglt_arena;
+
+void _ksgl_arena() {
+    ksglt_arena = ks_type_new(T_NAME, kst_object, sizeof(struct ksgl_arena_s), -1, "Sub-allocator which stores many ranges (i.e. meshes) in one large buffer", KS_IKV(
+        {"__free",                 ksf_wrap(T_free_, T_NAME ".__free(self)", "")},
+        {"__init",                 ksf_wrap(T_init_, T_NAME ".__init(self, size, stride=1, target=gl.ARRAY_BUFFER, usage=gl.STATIC_DRAW)", "Creates an arena of 'size' bytes, where allocations are aligned to 'stride' bytes (i.e. the size of a vertex)")},
+        {"__getattr",              ksf_wrap(T_getattr_, T_NAME ".__getattr(self, attr)", "")},
+
+        {"bind",                   ksf_wrap(T_bind_, T_NAME ".bind(self)", "Bind the arena's buffer to its target")},
+        {"unbind",                 ksf_wrap(T_unbind_, T_NAME ".unbind(self)", "Unbind the arena's buffer from its target")},
+
+        {"alloc",                  ksf_wrap(T_alloc_, T_NAME ".alloc(self, data=none, size=-1)", "Allocate a range (of 'size' bytes, or the size of 'data') and upload 'data' to it, returning a 'gl.ArenaAlloc'. Existing allocations are never moved, so if there is enough free space but no single range is large enough, a 'SizeError' is thrown (and 'defrag()' may be called)")},
+        {"free",                   ksf_wrap(T_free__, T_NAME ".free(self, alloc)", "Release an allocation before it is garbage collected")},
+        {"defrag",                 ksf_wrap(T_defrag_, T_NAME ".defrag(self)", "Move all allocations to the start of the buffer (updating their offsets), and return the number of bytes moved. Offsets (and base vertices) of allocations may change, so they should be re-read afterwards")},
+    ));
+}
@@ -0,0 +1,111 @@
+/* arena_alloc.c - gl.ArenaAlloc type
+ *
+ * @author: Cade Brown <cade@kscript.org>
+ */
+#include <ksgl.h>
+
+#define T_NAME M_NAME ".ArenaAlloc"
+
+
+/* Internals */
+
+/* C-API */
+
+/* Type Functions */
+
+static KS_TFUNC(T, free) {
+    ksgl_arena_alloc self;
+    KS_ARGS("self:*", &self, ksglt_arena_alloc);
+
+    ksgl_arena_release(self);
+
+    KSO_DEL(self);
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, init) {
+    ksgl_arena_alloc self;
+    KS_ARGS("self:*", &self, ksglt_arena_alloc);
+
+    KS_THROW(kst_TypeError, "'%T' cannot be created directly (use 'BufferArena.alloc()')", self);
+    return NULL;
+}
+
+static KS_TFUNC(T, str) {
+    ksgl_arena_alloc self;
+    KS_ARGS("self:*", &self, ksglt_arena_alloc);
+
+    return (kso)ks_fmt("<%T offset=%i, size=%i>", self, (int)self->offset, (int)self->size);
+}
+
+static KS_TFUNC(T, getattr) {
+    ksgl_arena_alloc self;
+    ks_str attr;
+    KS_ARGS("self:* attr:*", &self, ksglt_arena_alloc, &attr, kst_str);
+
+    if (ks_str_eq_c(attr, "offset", 6)) {
+        return (kso)ks_int_new(self->offset);
+    } else if (ks_str_eq_c(attr, "size", 4)) {
+        return (kso)ks_int_new(self->size);
+    } else if (ks_str_eq_c(attr, "arena", 5)) {
+        return self->arena ? KS_NEWREF(self->arena) : KSO_NONE;
+    } else if (ks_str_eq_c(attr, "base", 4)) {
+        /* Index of the first element, i.e. the base vertex */
+        return (kso)ks_int_new(self->arena ? self->offset / self->arena->stride : 0);
+    } else if (ks_str_eq_c(attr, "count", 5)) {
+        return (kso)ks_int_new(self->arena ? self->size / self->arena->stride : 0);
+    }
+
+    KS_THROW_ATTR(self, attr);
+    return NULL;
+}
+
+static KS_TFUNC(T, write) {
+    ksgl_arena_alloc self;
+    kso data;
+    ks_cint offset = 0;
+    KS_ARGS("self:* data ?offset:cint", &self, ksglt_arena_alloc, &data, &offset);
+
+    if (!self->arena) {
+        KS_THROW(kst_Error, "Allocation has already been freed");
+        return NULL;
+    }
+
+    /* Get the raw data (without copying, if possible) */
+    ksgl_buf buf;
+    if (!ksgl_buf_get(data, &buf)) {
+        return NULL;
+    }
+
+    if (offset < 0 || offset + buf.len > self->size) {
+        KS_THROW(kst_SizeError, "Writing %i bytes at offset %i is out of range for an allocation of %i bytes", (int)buf.len, (int)offset, (int)self->size);
+        ksgl_buf_done(&buf);
+        return NULL;
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, self->arena->val);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, self->offset + offset, buf.len, buf.data);
+    ksgl_buf_done(&buf);
+    if (!ksgl_check()) {
+        return NULL;
+    }
+
+    return KSO_NONE;
+}
+
+
+/* Export */
+
+ks_type ksglt_arena_alloc;
+
+void _ksgl_arena_alloc() {
+    ksglt_arena_alloc = ks_type_new(T_NAME, kst_object, sizeof(struct ksgl_arena_alloc_s), -1, "Range allocated from a 'gl.BufferArena'", KS_IKV(
+        {"__free",                 ksf_wrap(T_free_, T_NAME ".__free(self)", "")},
+        {"__init",                 ksf_wrap(T_init_, T_NAME ".__init(self)", "")},
+        {"__str",                  ksf_wrap(T_str_, T_NAME ".__str(self)", "")},
+        {"__repr",                 ksf_wrap(T_str_, T_NAME ".__repr(self)", "")},
+        {"__getattr",              ksf_wrap(T_getattr_, T_NAME ".__getattr(self, attr)", "")},
+
+        {"write",                  ksf_wrap(T_write_, T_NAME ".write(self, data, offset=0)", "Writes a bytes-like object into the allocation, at 'offset' bytes from its start")},
+    ));
+}
@@ -0,0 +1,182 @@
+/* asyncread.c - gl.AsyncRead type
+ *
+ * @author: Cade Brown <cade@kscript.org>
+ */
+#include <ksgl.h>
+
+#define T_NAME M_NAME ".AsyncRead"
+
+
+/* Internals */
+
+/* C-API */
+
+ksgl_asyncread ksgl_asyncread_start(int buf, ks_size_t offset, ks_size_t size, ksgl_asyncread reuse) {
+    ksgl_asyncread res;
+    if (reuse) {
+        /* Drop the previous read, if it is still pending */
+        if (reuse->fence) {
+            glDeleteSync(reuse->fence);
+            reuse->fence = NULL;
+        }
+        KS_INCREF(reuse);
+        res = reuse;
+    } else {
+        res = KSO_NEW(ksgl_asyncread, ksglt_asyncread);
+        res->val = -1;
+        res->size = res->cap = 0;
+        res->fence = NULL;
+    }
+
+    if (res->val < 0) {
+        res->val = ksgl_ctx_gen(KSGL_OBJ_BUFFER);
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, res->val);
+    if (size > res->cap) {
+        /* Grow the staging buffer */
+        glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_READ);
+        if (!ksgl_check()) {
+            KS_DECREF(res);
+            return NULL;
+        }
+        res->cap = size;
+    }
+    res->size = size;
+
+    /* Copy on the GPU, and then fence it */
+    glBindBuffer(GL_COPY_READ_BUFFER, buf);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, 0, size);
+    if (!ksgl_check()) {
+        KS_DECREF(res);
+        return NULL;
+    }
+
+    res->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    res->flushed = false;
+    if (!ksgl_check()) {
+        KS_DECREF(res);
+        return NULL;
+    }
+
+    return res;
+}
+
+/* Type Functions */
+
+static KS_TFUNC(T, free) {
+    ksgl_asyncread self;
+    KS_ARGS("self:*", &self, ksglt_asyncread);
+
+    if (self->fence) glDeleteSync(self->fence);
+    if (self->val >= 0) ksgl_ctx_release(KSGL_OBJ_BUFFER, self->val, NULL);
+
+    KSO_DEL(self);
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, init) {
+    ksgl_asyncread self;
+    KS_ARGS("self:*", &self, ksglt_asyncread);
+
+    KS_THROW(kst_TypeError, "'%T' cannot be created directly (use 'VBO.read_async()')", self);
+    return NULL;
+}
+
+static KS_TFUNC(T, getattr) {
+    ksgl_asyncread self;
+    ks_str attr;
+    KS_ARGS("self:* attr:*", &self, ksglt_asyncread, &attr, kst_str);
+
+    if (ks_str_eq_c(attr, "size", 4)) {
+        return (kso)ks_int_new(self->size);
+    } else if (ks_str_eq_c(attr, "ready", 5)) {
+        if (!self->fence) {
+            return KSO_TRUE;
+        }
+
+        /* Poll, without waiting (but flush the first time, so that the fence is sure to be signaled eventually) */
+        GLenum rc = glClientWaitSync(self->fence, self->flushed ? 0 : GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        self->flushed = true;
+        if (rc == GL_WAIT_FAILED) {
+            glDeleteSync(self->fence);
+            self->fence = NULL;
+            if (ksgl_check()) {
+                KS_THROW(kst_Error, "Failed to wait for fence");
+            }
+            return NULL;
+        }
+        return KSO_BOOL(rc == GL_ALREADY_SIGNALED || rc == GL_CONDITION_SATISFIED);
+    }
+
+    KS_THROW_ATTR(self, attr);
+    return NULL;
+}
+
+static KS_TFUNC(T, read) {
+    ksgl_asyncread self;
+    KS_ARGS("self:*", &self, ksglt_asyncread);
+
+    if (!ksgl_fence_wait(&self->fence)) {
+        return NULL;
+    }
+
+    void* data = ks_malloc(self->size);
+    if (!data && self->size > 0) {
+        KS_THROW(kst_Error, "Failed to allocate data");
+        return NULL;
+    }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, self->val);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, self->size, data);
+    if (!ksgl_check()) {
+        ks_free(data);
+        return NULL;
+    }
+
+    return (kso)ks_bytes_newn(self->size, data);
+}
+
+static KS_TFUNC(T, read_into) {
+    ksgl_asyncread self;
+    kso out;
+    KS_ARGS("self:* out", &self, ksglt_asyncread, &out);
+
+    nx_t val;
+    if (!ksgl_getnx(out, &val)) {
+        return NULL;
+    }
+
+    ks_size_t len = ksgl_nbytes(val);
+    if (len > self->size) {
+        KS_THROW(kst_SizeError, "Array is %i bytes, but only %i bytes were read", (int)len, (int)self->size);
+        return NULL;
+    }
+
+    if (!ksgl_fence_wait(&self->fence)) {
+        return NULL;
+    }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, self->val);
+    if (!ksgl_read_into(GL_COPY_READ_BUFFER, 0, val)) {
+        return NULL;
+    }
+
+    return KS_NEWREF(out);
+}
+
+
+/* Export */
+
+ks_type ksglt_asyncread;
+
+void _ksgl_asyncread() {
+    ksglt_asyncread = ks_type_new(T_NAME, kst_object, sizeof(struct ksgl_asyncread_s), -1, "Pending asynchronous read of a buffer, created by 'VBO.read_async()'", KS_IKV(
+        {"__free",                 ksf_wrap(T_free_, T_NAME ".__free(self)", "")},
+        {"__init",                 ksf_wrap(T_init_, T_NAME ".__init(self)", "")},
+        {"__getattr",              ksf_wrap(T_getattr_, T_NAME ".__getattr(self, attr)", "")},
+
+        {"read",                   ksf_wrap(T_read_, T_NAME ".read(self)", "Returns the data as a bytes object, waiting for the copy to finish if it hasn't yet (check '.ready' to avoid stalling)")},
+        {"read_into",              ksf_wrap(T_read_into_, T_NAME ".read_into(self, out)", "Reads the data into an existing array 'out' (without allocating, if it is dense), waiting for the copy to finish if it hasn't yet. Returns 'out'")},
+    ));
+}
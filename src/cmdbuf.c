@@ -0,0 +1,320 @@
+/* cmdbuf.c - gl.CommandBuffer type
+ *
+ * @author: Cade Brown <cade@kscript.org>
+ */
+#include <ksgl.h>
+
+#define T_NAME M_NAME ".CommandBuffer"
+
+
+/* Internals */
+
+/* Add a command to the end of 'self' */
+static void my_add(ksgl_cmdbuf self, int kind, GLint a0, GLint a1, GLint a2, GLint a3) {
+    self->cmds = ks_zrealloc(self->cmds, sizeof(*self->cmds), self->ncmds + 1);
+    struct ksgl_cmd* c = &self->cmds[self->ncmds++];
+    c->kind = kind;
+    c->args[0] = a0;
+    c->args[1] = a1;
+    c->args[2] = a2;
+    c->args[3] = a3;
+}
+
+/* Keep a reference to 'obj', returning its index in 'objs' */
+static int my_ref(ksgl_cmdbuf self, kso obj) {
+    ks_list_push(self->objs, obj);
+    return self->objs->len - 1;
+}
+
+
+/* C-API */
+
+/* Type Functions */
+
+static KS_TFUNC(T, free) {
+    ksgl_cmdbuf self;
+    KS_ARGS("self:*", &self, ksglt_cmdbuf);
+
+    ks_free(self->cmds);
+    ks_free(self->uniforms);
+    KS_NDECREF(self->objs);
+
+    KSO_DEL(self);
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, init) {
+    ksgl_cmdbuf self;
+    KS_ARGS("self:*", &self, ksglt_cmdbuf);
+
+    self->ncmds = 0;
+    self->cmds = NULL;
+    self->nuniforms = 0;
+    self->uniforms = NULL;
+    self->objs = ks_list_new(0, NULL);
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, getattr) {
+    ksgl_cmdbuf self;
+    ks_str attr;
+    KS_ARGS("self:* attr:*", &self, ksglt_cmdbuf, &attr, kst_str);
+
+    if (ks_str_eq_c(attr, "ncmds", 5)) {
+        return (kso)ks_int_new(self->ncmds);
+    } else if (ks_str_eq_c(attr, "nuniforms", 9)) {
+        return (kso)ks_int_new(self->nuniforms);
+    }
+
+    KS_THROW_ATTR(self, attr);
+    return NULL;
+}
+
+static KS_TFUNC(T, reset) {
+    ksgl_cmdbuf self;
+    KS_ARGS("self:*", &self, ksglt_cmdbuf);
+
+    self->ncmds = 0;
+    self->nuniforms = 0;
+    ks_list_clear(self->objs);
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, use) {
+    ksgl_cmdbuf self;
+    ksgl_shader shader;
+    KS_ARGS("self:* shader:*", &self, ksglt_cmdbuf, &shader, ksglt_shader);
+
+    if (!ksgl_shader_finish(shader)) {
+        return NULL;
+    }
+
+    my_add(self, KSGL_CMD_USE, my_ref(self, (kso)shader), 0, 0, 0);
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, bind) {
+    ksgl_cmdbuf self;
+    ksgl_vao vao;
+    KS_ARGS("self:* vao:*", &self, ksglt_cmdbuf, &vao, ksglt_vao);
+
+    my_add(self, KSGL_CMD_BIND, my_ref(self, (kso)vao), 0, 0, 0);
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, texture) {
+    ksgl_cmdbuf self;
+    ksgl_texture2d tex;
+    ks_cint unit = 0;
+    KS_ARGS("self:* tex:* ?unit:cint", &self, ksglt_cmdbuf, &tex, ksglt_texture2d, &unit);
+
+    my_add(self, KSGL_CMD_TEXTURE, my_ref(self, (kso)tex), unit, 0, 0);
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, enable) {
+    ksgl_cmdbuf self;
+    ks_cint cap;
+    KS_ARGS("self:* cap:cint", &self, ksglt_cmdbuf, &cap);
+
+    my_add(self, KSGL_CMD_ENABLE, cap, 0, 0, 0);
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, disable) {
+    ksgl_cmdbuf self;
+    ks_cint cap;
+    KS_ARGS("self:* cap:cint", &self, ksglt_cmdbuf, &cap);
+
+    my_add(self, KSGL_CMD_DISABLE, cap, 0, 0, 0);
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, clear) {
+    ksgl_cmdbuf self;
+    ks_cint flags;
+    KS_ARGS("self:* flags:cint", &self, ksglt_cmdbuf, &flags);
+
+    my_add(self, KSGL_CMD_CLEAR, flags, 0, 0, 0);
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, viewport) {
+    ksgl_cmdbuf self;
+    ks_cint x, y, w, h;
+    KS_ARGS("self:* x:cint y:cint w:cint h:cint", &self, ksglt_cmdbuf, &x, &y, &w, &h);
+
+    my_add(self, KSGL_CMD_VIEWPORT, x, y, w, h);
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, uniform) {
+    ksgl_cmdbuf self;
+    ksgl_shader shader;
+    ks_str name;
+    kso val;
+    KS_ARGS("self:* shader:* name:* val", &self, ksglt_cmdbuf, &shader, ksglt_shader, &name, kst_str, &val);
+
+    /* Look up the location once, when recording */
+    int pos = ksgl_shader_uniformloc(shader, name);
+    if (pos < 0) {
+        return NULL;
+    }
+
+    ksgl_uniform u;
+    if (!ksgl_uniform_get(val, &u)) {
+        return NULL;
+    }
+
+    int slot = self->nuniforms++;
+    self->uniforms = ks_zrealloc(self->uniforms, sizeof(*self->uniforms), self->nuniforms);
+    self->uniforms[slot] = u;
+
+    my_add(self, KSGL_CMD_UNIFORM, pos, slot, 0, 0);
+    return (kso)ks_int_new(slot);
+}
+
+static KS_TFUNC(T, patch) {
+    ksgl_cmdbuf self;
+    ks_cint slot;
+    kso val;
+    KS_ARGS("self:* slot:cint val", &self, ksglt_cmdbuf, &slot, &val);
+
+    if (slot < 0 || slot >= self->nuniforms) {
+        KS_THROW(kst_IndexError, "Uniform slot %i is out of range", (int)slot);
+        return NULL;
+    }
+
+    ksgl_uniform u;
+    if (!ksgl_uniform_get(val, &u)) {
+        return NULL;
+    }
+
+    /* Must have the same type, since the recorded location expects it */
+    ksgl_uniform* cur = &self->uniforms[slot];
+    if (u.isint != cur->isint || u.m != cur->m || u.n != cur->n) {
+        KS_THROW(kst_TypeError, "Uniform slot %i was recorded with a different type or shape", (int)slot);
+        return NULL;
+    }
+
+    *cur = u;
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, draw) {
+    ksgl_cmdbuf self;
+    ksgl_vao vao;
+    ks_cint instances = -1;
+    KS_ARGS("self:* vao:* ?instances:cint", &self, ksglt_cmdbuf, &vao, ksglt_vao, &instances);
+
+    my_add(self, KSGL_CMD_DRAW, my_ref(self, (kso)vao), instances, 0, 0);
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, draw_arrays) {
+    ksgl_cmdbuf self;
+    ks_cint mode, num, offset = 0;
+    KS_ARGS("self:* mode:cint num:cint ?offset:cint", &self, ksglt_cmdbuf, &mode, &num, &offset);
+
+    my_add(self, KSGL_CMD_DRAW_ARRAYS, mode, num, offset, 0);
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, draw_elements) {
+    ksgl_cmdbuf self;
+    ks_cint mode, num, type, byteoffset = 0;
+    KS_ARGS("self:* mode:cint num:cint type:cint ?byteoffset:cint", &self, ksglt_cmdbuf, &mode, &num, &type, &byteoffset);
+
+    my_add(self, KSGL_CMD_DRAW_ELEMENTS, mode, num, type, byteoffset);
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, submit) {
+    ksgl_cmdbuf self;
+    KS_ARGS("self:*", &self, ksglt_cmdbuf);
+
+    kso* objs = self->objs->elems;
+    int i;
+    for (i = 0; i < self->ncmds; ++i) {
+        struct ksgl_cmd* c = &self->cmds[i];
+        switch (c->kind) {
+            case KSGL_CMD_USE:
+                ksgl_ctx_useprogram(((ksgl_shader)objs[c->args[0]])->val);
+                break;
+            case KSGL_CMD_BIND:
+                ksgl_ctx_bindvao(((ksgl_vao)objs[c->args[0]])->val, true);
+                break;
+            case KSGL_CMD_TEXTURE:
+                ksgl_ctx_bindtex(c->args[1], ((ksgl_texture2d)objs[c->args[0]])->val);
+                break;
+            case KSGL_CMD_ENABLE:
+                ksgl_ctx_enable(c->args[0], true);
+                break;
+            case KSGL_CMD_DISABLE:
+                ksgl_ctx_enable(c->args[0], false);
+                break;
+            case KSGL_CMD_UNIFORM:
+                ksgl_uniform_set(c->args[0], &self->uniforms[c->args[1]]);
+                break;
+            case KSGL_CMD_CLEAR:
+                glClear(c->args[0]);
+                break;
+            case KSGL_CMD_VIEWPORT:
+                ksgl_ctx_viewport(c->args[0], c->args[1], c->args[2], c->args[3]);
+                break;
+            case KSGL_CMD_DRAW:
+                if (!ksgl_vao_draw((ksgl_vao)objs[c->args[0]], c->args[1])) {
+                    return NULL;
+                }
+                break;
+            case KSGL_CMD_DRAW_ARRAYS:
+                glDrawArrays(c->args[0], c->args[2], c->args[1]);
+                break;
+            case KSGL_CMD_DRAW_ELEMENTS:
+                ksgl_ctx_norestart();
+                glDrawElements(c->args[0], c->args[1], c->args[2], (void*)(ks_uint)c->args[3]);
+                break;
+        }
+    }
+
+    /* Check once, for the whole buffer */
+    if (!ksgl_check()) {
+        return NULL;
+    }
+
+    return KSO_NONE;
+}
+
+
+/* Export */
+
+ks_type ksglt_cmdbuf;
+
+void _ksgl_cmdbuf() {
+    ksglt_cmdbuf = ks_type_new(T_NAME, kst_object, sizeof(struct ksgl_cmdbuf_s), -1, "Sequence of recorded OpenGL commands, which are replayed natively by 'submit()'", KS_IKV(
+        {"__free",                 ksf_wrap(T_free_, T_NAME ".__free(self)", "")},
+        {"__init",                 ksf_wrap(T_init_, T_NAME ".__init(self)", "Creates an empty command buffer")},
+        {"__getattr",              ksf_wrap(T_getattr_, T_NAME ".__getattr(self, attr)", "")},
+
+        {"reset",                  ksf_wrap(T_reset_, T_NAME ".reset(self)", "Removes all recorded commands")},
+
+        {"use",                    ksf_wrap(T_use_, T_NAME ".use(self, shader)", "Records 'shader.use()'")},
+        {"bind",                   ksf_wrap(T_bind_, T_NAME ".bind(self, vao)", "Records 'vao.bind()'")},
+        {"texture",                ksf_wrap(T_texture_, T_NAME ".texture(self, tex, unit=0)", "Records binding 'tex' to texture unit 'unit'")},
+        {"enable",                 ksf_wrap(T_enable_, T_NAME ".enable(self, cap)", "Records 'gl.enable(cap)'")},
+        {"disable",                ksf_wrap(T_disable_, T_NAME ".disable(self, cap)", "Records 'gl.disable(cap)'")},
+        {"clear",                  ksf_wrap(T_clear_, T_NAME ".clear(self, flags)", "Records 'gl.clear(flags)'")},
+        {"viewport",               ksf_wrap(T_viewport_, T_NAME ".viewport(self, x, y, w, h)", "Records 'gl.viewport(x, y, w, h)'")},
+
+        {"uniform",                ksf_wrap(T_uniform_, T_NAME ".uniform(self, shader, name, val)", "Records setting the uniform 'name' of 'shader' (which should be in use when it is replayed) to 'val', and returns a slot which can be given to 'patch()'")},
+        {"patch",                  ksf_wrap(T_patch_, T_NAME ".patch(self, slot, val)", "Replaces the value of a recorded uniform, for the next time the buffer is submitted. 'val' must have the same type and shape as the recorded value")},
+
+        {"draw",                   ksf_wrap(T_draw_, T_NAME ".draw(self, vao, instances=-1)", "Records 'vao.draw(instances)'")},
+        {"draw_arrays",            ksf_wrap(T_draw_arrays_, T_NAME ".draw_arrays(self, mode, num, offset=0)", "Records 'gl.draw_arrays(mode, num, offset)'")},
+        {"draw_elements",          ksf_wrap(T_draw_elements_, T_NAME ".draw_elements(self, mode, num, type, byteoffset=0)", "Records 'gl.draw_elements(mode, num, type, byteoffset)'")},
+
+        {"submit",                 ksf_wrap(T_submit_, T_NAME ".submit(self)", "Replays every recorded command, in order")},
+    ));
+}
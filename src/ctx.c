@@ -0,0 +1,417 @@
+/* ctx.c - OpenGL context state (handle generation, recycling, and deferred deletion)
+ *
+ * @author: Cade Brown <cade@kscript.org>
+ */
+#include <ksgl.h>
+
+
+/* Global context state */
+struct ksgl_ctx_s ksgl_ctx;
+
+
+/* Internals */
+
+/* Generate 'n' handles of 'kind' */
+static void my_gen(int kind, int n, GLuint* out) {
+    if (kind == KSGL_OBJ_BUFFER) {
+        glGenBuffers(n, out);
+    } else if (kind == KSGL_OBJ_TEXTURE) {
+        glGenTextures(n, out);
+    } else if (kind == KSGL_OBJ_VAO) {
+        glGenVertexArrays(n, out);
+    }
+
+    ksgl_stats.n_gen += n;
+}
+
+/* Delete 'n' handles of 'kind' */
+static void my_del(int kind, int n, GLuint* vals) {
+    if (n <= 0) {
+        return;
+    }
+
+    /* Deleting a bound object unbinds it */
+    int i, j;
+    if (kind == KSGL_OBJ_BUFFER) {
+        for (i = 0; i < n; ++i) {
+            if (vals[i] == ksgl_ctx.arraybuf) ksgl_ctx.arraybuf = 0;
+        }
+        glDeleteBuffers(n, vals);
+    } else if (kind == KSGL_OBJ_TEXTURE) {
+        for (i = 0; i < n; ++i) {
+            for (j = 0; j < KSGL_MAXUNITS; ++j) {
+                if (vals[i] == ksgl_ctx.tex[j]) ksgl_ctx.tex[j] = 0;
+            }
+        }
+        glDeleteTextures(n, vals);
+    } else if (kind == KSGL_OBJ_VAO) {
+        for (i = 0; i < n; ++i) {
+            if (vals[i] == ksgl_ctx.vao) {
+                ksgl_ctx.vao = 0;
+                ksgl_ctx.vao_draw = false;
+            }
+        }
+        glDeleteVertexArrays(n, vals);
+    }
+
+    ksgl_stats.n_delete += n;
+    ksgl_stats.n_delete_batch++;
+}
+
+/* Returns whether 'cap' is known to be enabled */
+static bool my_enabled(GLenum cap) {
+    int i;
+    for (i = 0; i < ksgl_ctx.ncaps; ++i) {
+        if (ksgl_ctx.caps[i].cap == cap) return ksgl_ctx.caps[i].on;
+    }
+
+    return false;
+}
+
+/* Queue a handle for deletion */
+static void my_queue(int kind, GLuint val) {
+    ksgl_ctx.del[kind] = ks_zrealloc(ksgl_ctx.del[kind], sizeof(*ksgl_ctx.del[kind]), ksgl_ctx.ndel[kind] + 1);
+    ksgl_ctx.del[kind][ksgl_ctx.ndel[kind]++] = val;
+}
+
+
+/* C-API */
+
+GLuint ksgl_ctx_gen(int kind) {
+    if (ksgl_ctx.nspare[kind] == 0) {
+        /* Generate a batch at once */
+        my_gen(kind, KSGL_GEN_BATCH, ksgl_ctx.spare[kind]);
+        ksgl_ctx.nspare[kind] = KSGL_GEN_BATCH;
+    }
+
+    return ksgl_ctx.spare[kind][--ksgl_ctx.nspare[kind]];
+}
+
+bool ksgl_ctx_take(int kind, ks_size_t* key, GLuint* val) {
+    /* Search newest first, since they are the most likely to be reused again */
+    int i;
+    for (i = ksgl_ctx.npool[kind] - 1; i >= 0; --i) {
+        struct ksgl_pooled* p = &ksgl_ctx.pool[kind][i];
+        if (p->key[0] == key[0] && p->key[1] == key[1] && p->key[2] == key[2]) {
+            *val = p->val;
+            memmove(p, p + 1, sizeof(*p) * (ksgl_ctx.npool[kind] - i - 1));
+            ksgl_ctx.npool[kind]--;
+
+            if (kind == KSGL_OBJ_BUFFER) {
+                /* Orphan the old storage, which may still be in use by the GPU */
+                glBindBuffer(GL_COPY_WRITE_BUFFER, *val);
+                glBufferData(GL_COPY_WRITE_BUFFER, key[0], NULL, key[1]);
+            }
+
+            ksgl_stats.n_recycle++;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ksgl_ctx_release(int kind, GLuint val, ks_size_t* key) {
+    if (!key) {
+        my_queue(kind, val);
+        return;
+    }
+
+    if (ksgl_ctx.npool[kind] >= KSGL_POOL_MAX) {
+        /* Evict the oldest */
+        my_queue(kind, ksgl_ctx.pool[kind][0].val);
+        memmove(&ksgl_ctx.pool[kind][0], &ksgl_ctx.pool[kind][1], sizeof(ksgl_ctx.pool[kind][0]) * (KSGL_POOL_MAX - 1));
+        ksgl_ctx.npool[kind]--;
+    }
+
+    struct ksgl_pooled* p = &ksgl_ctx.pool[kind][ksgl_ctx.npool[kind]++];
+    p->val = val;
+    p->key[0] = key[0];
+    p->key[1] = key[1];
+    p->key[2] = key[2];
+    p->frame = ksgl_ctx.frame;
+}
+
+void ksgl_ctx_bindvao(GLuint val, bool draw) {
+    ksgl_ctx.vao_draw = draw && val != 0;
+    if (ksgl_ctx.vao == val) {
+        ksgl_stats.n_state_skip++;
+        return;
+    }
+
+    glBindVertexArray(val);
+    ksgl_ctx.vao = val;
+    ksgl_stats.n_state_change++;
+}
+
+void ksgl_ctx_bindbuf(GLenum target, GLuint val) {
+    if (target != GL_ARRAY_BUFFER) {
+        /* Only GL_ARRAY_BUFFER is tracked (the element buffer is part of the VAO) */
+        glBindBuffer(target, val);
+        return;
+    }
+
+    if (ksgl_ctx.arraybuf == val) {
+        ksgl_stats.n_state_skip++;
+        return;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, val);
+    ksgl_ctx.arraybuf = val;
+    ksgl_stats.n_state_change++;
+}
+
+void ksgl_ctx_useprogram(GLuint val) {
+    if (ksgl_ctx.program == val) {
+        ksgl_stats.n_state_skip++;
+        return;
+    }
+
+    glUseProgram(val);
+    ksgl_ctx.program = val;
+    ksgl_stats.n_state_change++;
+}
+
+void ksgl_ctx_bindtex(int unit, GLuint val) {
+    if (unit < 0) {
+        if (ksgl_ctx.unit < 0) {
+            /* Active unit is unknown, so ask */
+            GLint v;
+            glGetIntegerv(GL_ACTIVE_TEXTURE, &v);
+            ksgl_ctx.unit = v - GL_TEXTURE0;
+        }
+        unit = ksgl_ctx.unit;
+    }
+    if (unit >= KSGL_MAXUNITS) {
+        /* Not tracked */
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, val);
+        ksgl_ctx.unit = unit;
+        ksgl_stats.n_state_change++;
+        return;
+    }
+
+    if (ksgl_ctx.unit != unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        ksgl_ctx.unit = unit;
+    }
+
+    if (ksgl_ctx.tex[unit] == val) {
+        ksgl_stats.n_state_skip++;
+        return;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, val);
+    ksgl_ctx.tex[unit] = val;
+    ksgl_stats.n_state_change++;
+}
+
+void ksgl_ctx_enable(GLenum cap, bool on) {
+    /* Setting it explicitly means it is no longer just for strips */
+    if (cap == GL_PRIMITIVE_RESTART) ksgl_ctx.autorestart = false;
+
+    int i;
+    for (i = 0; i < ksgl_ctx.ncaps; ++i) {
+        if (ksgl_ctx.caps[i].cap == cap) break;
+    }
+
+    if (i < ksgl_ctx.ncaps && ksgl_ctx.caps[i].on == on) {
+        ksgl_stats.n_state_skip++;
+        return;
+    }
+
+    if (on) {
+        glEnable(cap);
+    } else {
+        glDisable(cap);
+    }
+    ksgl_stats.n_state_change++;
+
+    if (i == ksgl_ctx.ncaps) {
+        /* Start tracking it, if there is room */
+        if (i >= KSGL_MAXCAPS) return;
+        ksgl_ctx.caps[ksgl_ctx.ncaps++].cap = cap;
+    }
+    ksgl_ctx.caps[i].on = on;
+}
+
+void ksgl_ctx_restart(GLuint idx) {
+    bool autorestart = ksgl_ctx.autorestart || !my_enabled(GL_PRIMITIVE_RESTART);
+    ksgl_ctx_enable(GL_PRIMITIVE_RESTART, true);
+    ksgl_ctx.autorestart = autorestart;
+
+    if (ksgl_ctx.hasrestart && ksgl_ctx.restart == idx) {
+        ksgl_stats.n_state_skip++;
+        return;
+    }
+
+    glPrimitiveRestartIndex(idx);
+    ksgl_ctx.hasrestart = true;
+    ksgl_ctx.restart = idx;
+    ksgl_stats.n_state_change++;
+}
+
+void ksgl_ctx_norestart() {
+    if (ksgl_ctx.autorestart) {
+        ksgl_ctx_enable(GL_PRIMITIVE_RESTART, false);
+    }
+}
+
+void ksgl_ctx_viewport(GLint x, GLint y, GLint w, GLint h) {
+    if (ksgl_ctx.hasviewport && ksgl_ctx.viewport[0] == x && ksgl_ctx.viewport[1] == y && ksgl_ctx.viewport[2] == w && ksgl_ctx.viewport[3] == h) {
+        ksgl_stats.n_state_skip++;
+        return;
+    }
+
+    glViewport(x, y, w, h);
+    ksgl_ctx.hasviewport = true;
+    ksgl_ctx.viewport[0] = x;
+    ksgl_ctx.viewport[1] = y;
+    ksgl_ctx.viewport[2] = w;
+    ksgl_ctx.viewport[3] = h;
+    ksgl_stats.n_state_change++;
+}
+
+void ksgl_ctx_bindfbo(GLuint val) {
+    if (ksgl_ctx.framebuffer == val) {
+        ksgl_stats.n_state_skip++;
+        return;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, val);
+    ksgl_ctx.framebuffer = val;
+    ksgl_stats.n_state_change++;
+}
+
+void ksgl_ctx_depthfunc(GLenum func) {
+    if (ksgl_ctx.depthfunc == func) {
+        ksgl_stats.n_state_skip++;
+        return;
+    }
+
+    glDepthFunc(func);
+    ksgl_ctx.depthfunc = func;
+    ksgl_stats.n_state_change++;
+}
+
+void ksgl_ctx_depthmask(bool on) {
+    if (ksgl_ctx.depthmask == on) {
+        ksgl_stats.n_state_skip++;
+        return;
+    }
+
+    glDepthMask(on ? GL_TRUE : GL_FALSE);
+    ksgl_ctx.depthmask = on;
+    ksgl_stats.n_state_change++;
+}
+
+void ksgl_ctx_blendfunc(GLenum src, GLenum dst) {
+    if (ksgl_ctx.blendsrc == src && ksgl_ctx.blenddst == dst) {
+        ksgl_stats.n_state_skip++;
+        return;
+    }
+
+    glBlendFunc(src, dst);
+    ksgl_ctx.blendsrc = src;
+    ksgl_ctx.blenddst = dst;
+    ksgl_stats.n_state_change++;
+}
+
+void ksgl_ctx_cullface(GLenum face) {
+    if (ksgl_ctx.cullface == face) {
+        ksgl_stats.n_state_skip++;
+        return;
+    }
+
+    glCullFace(face);
+    ksgl_ctx.cullface = face;
+    ksgl_stats.n_state_change++;
+}
+
+void ksgl_ctx_polygonmode(GLenum mode) {
+    if (ksgl_ctx.polygonmode == mode) {
+        ksgl_stats.n_state_skip++;
+        return;
+    }
+
+    glPolygonMode(GL_FRONT_AND_BACK, mode);
+    ksgl_ctx.polygonmode = mode;
+    ksgl_stats.n_state_change++;
+}
+
+void ksgl_ctx_clearcolor(GLfloat r, GLfloat g, GLfloat b, GLfloat a) {
+    if (ksgl_ctx.hasclearcolor && ksgl_ctx.clearcolor[0] == r && ksgl_ctx.clearcolor[1] == g && ksgl_ctx.clearcolor[2] == b && ksgl_ctx.clearcolor[3] == a) {
+        ksgl_stats.n_state_skip++;
+        return;
+    }
+
+    glClearColor(r, g, b, a);
+    ksgl_ctx.hasclearcolor = true;
+    ksgl_ctx.clearcolor[0] = r;
+    ksgl_ctx.clearcolor[1] = g;
+    ksgl_ctx.clearcolor[2] = b;
+    ksgl_ctx.clearcolor[3] = a;
+    ksgl_stats.n_state_change++;
+}
+
+void ksgl_ctx_cleardepth(GLdouble depth) {
+    if (ksgl_ctx.hascleardepth && ksgl_ctx.cleardepth == depth) {
+        ksgl_stats.n_state_skip++;
+        return;
+    }
+
+    glClearDepth(depth);
+    ksgl_ctx.hascleardepth = true;
+    ksgl_ctx.cleardepth = depth;
+    ksgl_stats.n_state_change++;
+}
+
+void ksgl_ctx_invalidate() {
+    ksgl_ctx.vao = KSGL_UNKNOWN;
+    ksgl_ctx.vao_draw = false;
+    ksgl_ctx.program = KSGL_UNKNOWN;
+    ksgl_ctx.arraybuf = KSGL_UNKNOWN;
+    ksgl_ctx.unit = -1;
+
+    int i;
+    for (i = 0; i < KSGL_MAXUNITS; ++i) {
+        ksgl_ctx.tex[i] = KSGL_UNKNOWN;
+    }
+
+    ksgl_ctx.ncaps = 0;
+    ksgl_ctx.hasrestart = false;
+    ksgl_ctx.autorestart = false;
+    ksgl_ctx.hasviewport = false;
+
+    ksgl_ctx.framebuffer = KSGL_UNKNOWN;
+    ksgl_ctx.depthfunc = KSGL_UNKNOWN;
+    ksgl_ctx.blendsrc = KSGL_UNKNOWN;
+    ksgl_ctx.blenddst = KSGL_UNKNOWN;
+    ksgl_ctx.cullface = KSGL_UNKNOWN;
+    ksgl_ctx.polygonmode = KSGL_UNKNOWN;
+    ksgl_ctx.depthmask = -1;
+    ksgl_ctx.hasclearcolor = false;
+    ksgl_ctx.hascleardepth = false;
+}
+
+void ksgl_ctx_flush() {
+    int kind;
+    for (kind = 0; kind < KSGL_OBJ__N; ++kind) {
+        /* Expire recycled handles which haven't been reused (they are in order of age) */
+        int n = 0;
+        while (n < ksgl_ctx.npool[kind] && ksgl_ctx.frame - ksgl_ctx.pool[kind][n].frame >= KSGL_POOL_FRAMES) {
+            my_queue(kind, ksgl_ctx.pool[kind][n].val);
+            n++;
+        }
+        if (n > 0) {
+            memmove(&ksgl_ctx.pool[kind][0], &ksgl_ctx.pool[kind][n], sizeof(ksgl_ctx.pool[kind][0]) * (ksgl_ctx.npool[kind] - n));
+            ksgl_ctx.npool[kind] -= n;
+        }
+
+        /* Delete everything queued, in a single call */
+        my_del(kind, ksgl_ctx.ndel[kind], ksgl_ctx.del[kind]);
+        ksgl_ctx.ndel[kind] = 0;
+    }
+
+    ksgl_ctx.frame++;
+}
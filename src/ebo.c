@@ -9,6 +9,230 @@
 
 /* Internals */
 
+/* Returns the OpenGL index type that 'dtype' can be uploaded as directly (or 0 if it can't) */
+static int my_gltype(nx_dtype dtype) {
+    if (dtype == nxd_u32 || dtype == nxd_s32) {
+        return GL_UNSIGNED_INT;
+    } else if (dtype == nxd_u16 || dtype == nxd_s16) {
+        return GL_UNSIGNED_SHORT;
+    } else if (dtype == nxd_u8 || dtype == nxd_s8) {
+        return GL_UNSIGNED_BYTE;
+    }
+
+    return 0;
+}
+
+/* Bind 'val' as the element buffer of the current VAO
+ *
+ * A VAO that was left bound by drawing it is unbound first, so that its element buffer isn't replaced
+ */
+static void my_bind(int val) {
+    if (ksgl_ctx.vao_draw) ksgl_ctx_bindvao(0, false);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, val);
+}
+
+/* Get indices from 'data', storing the raw data in 'out' and the index type in '*type'
+ *
+ * Arrays of other integer types are converted to 32 bit indices in a single pass. If 'narrow' is 
+ *   non-zero, indices are narrowed (in place) to the smallest type of at least 'narrow' bits which 
+ *   can hold the maximum index. The maximum value of each type is never used, so that it is free
+ *   to be the primitive restart index
+ * 
+ * If 'strip', the indices are triangles which are converted to triangle strips, separated by the 
+ *   primitive restart index
+ *
+ * Other objects are assumed to be 32 bit indices
+ */
+static bool my_getidx(kso data, int narrow, bool strip, ksgl_buf* out, int* type) {
+    nx_u32* idx;
+    ks_size_t n;
+    if (!kso_issub(data->type, nxt_array) && !kso_issub(data->type, nxt_view)) {
+        *type = GL_UNSIGNED_INT;
+        if (!strip) {
+            return ksgl_buf_get(data, out);
+        }
+
+        ksgl_buf tb;
+        if (!ksgl_buf_getas(data, nxd_u32, &tb)) {
+            return false;
+        }
+
+        n = tb.len / sizeof(*idx);
+        idx = ks_malloc(sizeof(*idx) * (n > 0 ? n : 1));
+        if (!idx) {
+            KS_THROW(kst_Error, "Failed to allocate data");
+            ksgl_buf_done(&tb);
+            return false;
+        }
+        memcpy(idx, tb.data, tb.len);
+        ksgl_buf_done(&tb);
+    } else {
+        nx_t val;
+        if (!ksgl_getnx(data, &val)) {
+            return false;
+        }
+
+        *type = my_gltype(val.dtype);
+        if (*type != 0 && !narrow && !strip) {
+            /* Upload as-is */
+            return ksgl_buf_get(data, out);
+        }
+
+        /* Convert to 32 bit indices */
+        n = ksgl_nbytes(val) / val.dtype->size;
+        idx = ks_malloc(sizeof(*idx) * (n > 0 ? n : 1));
+        if (!idx) {
+            KS_THROW(kst_Error, "Failed to allocate data");
+            return false;
+        }
+        if (!nx_cast(val, nx_make(idx, nxd_u32, val.rank, val.shape, NULL))) {
+            ks_free(idx);
+            return false;
+        }
+    }
+
+    if (strip) {
+        if (n % 3 != 0) {
+            KS_THROW(kst_SizeError, "Expected a list of triangles, but got %i indices (which is not a multiple of 3)", (int)n);
+            ks_free(idx);
+            return false;
+        }
+
+        ks_size_t ns;
+        nx_u32* sidx = ksgl_stripify(idx, n / 3, ksgl_idxrestart(GL_UNSIGNED_INT), &ns);
+        ks_free(idx);
+        if (!sidx) {
+            return false;
+        }
+        idx = sidx;
+        n = ns;
+    }
+
+    ks_size_t i;
+    nx_u32 mx = 0;
+    for (i = 0; i < n; ++i) {
+        if (idx[i] > mx && idx[i] != ksgl_idxrestart(GL_UNSIGNED_INT)) mx = idx[i];
+    }
+
+    /* Restart indices become the maximum value of the narrower type */
+    ks_size_t sz;
+    if (narrow > 0 && narrow <= 8 && mx < 0xFF) {
+        for (i = 0; i < n; ++i) {
+            ((nx_u8*)idx)[i] = idx[i] == ksgl_idxrestart(GL_UNSIGNED_INT) ? ksgl_idxrestart(GL_UNSIGNED_BYTE) : idx[i];
+        }
+        *type = GL_UNSIGNED_BYTE;
+        sz = 1;
+    } else if (narrow > 0 && narrow <= 16 && mx < 0xFFFF) {
+        for (i = 0; i < n; ++i) {
+            ((nx_u16*)idx)[i] = idx[i] == ksgl_idxrestart(GL_UNSIGNED_INT) ? ksgl_idxrestart(GL_UNSIGNED_SHORT) : idx[i];
+        }
+        *type = GL_UNSIGNED_SHORT;
+        sz = 2;
+    } else {
+        *type = GL_UNSIGNED_INT;
+        sz = 4;
+    }
+
+    out->data = out->tmp = idx;
+    out->len = n * sz;
+    out->ref = NULL;
+
+    ksgl_stats.n_upload++;
+    ksgl_stats.sz_upload += out->len;
+    ksgl_stats.sz_upload_copied += n * sizeof(*idx);
+
+    return true;
+}
+
+/* Returns the dtype for an OpenGL index type */
+static nx_dtype my_nxtype(int type) {
+    if (type == GL_UNSIGNED_SHORT) {
+        return nxd_u16;
+    } else if (type == GL_UNSIGNED_BYTE) {
+        return nxd_u8;
+    }
+
+    return nxd_u32;
+}
+
+/* Get indices from 'data', converted to 'type' (in a single pass, if required)
+ *
+ * Indices are converted through 32 bit indices, so that those which don't fit in 'type' are caught
+ *   instead of being truncated. The 32 bit restart index becomes the restart index of 'type'
+ */
+static bool my_getidx_as(kso data, int type, ksgl_buf* out) {
+    if (!kso_issub(data->type, nxt_array) && !kso_issub(data->type, nxt_view)) {
+        return ksgl_buf_get(data, out);
+    }
+
+    nx_t val;
+    if (!ksgl_getnx(data, &val)) {
+        return false;
+    }
+    if (my_gltype(val.dtype) == type) {
+        return ksgl_buf_get(data, out);
+    }
+
+    ks_size_t n = ksgl_nbytes(val) / val.dtype->size;
+    nx_u32* idx = ks_malloc(sizeof(*idx) * (n > 0 ? n : 1));
+    if (!idx) {
+        KS_THROW(kst_Error, "Failed to allocate data");
+        return false;
+    }
+    if (!nx_cast(val, nx_make(idx, nxd_u32, val.rank, val.shape, NULL))) {
+        ks_free(idx);
+        return false;
+    }
+
+    /* Narrow in place */
+    GLuint rs = ksgl_idxrestart(type);
+    ks_size_t i;
+    for (i = 0; i < n; ++i) {
+        nx_u32 v = idx[i] == ksgl_idxrestart(GL_UNSIGNED_INT) ? rs : idx[i];
+        if (v > rs) {
+            KS_THROW(kst_SizeError, "Index %i does not fit in the index type of the buffer (which can hold up to %i)", (int)idx[i], (int)rs - 1);
+            ks_free(idx);
+            return false;
+        }
+
+        if (type == GL_UNSIGNED_BYTE) {
+            ((nx_u8*)idx)[i] = v;
+        } else if (type == GL_UNSIGNED_SHORT) {
+            ((nx_u16*)idx)[i] = v;
+        }
+    }
+
+    ks_size_t len = n * ksgl_idxsize(type);
+    out->data = out->tmp = idx;
+    out->len = len;
+    out->ref = NULL;
+
+    ksgl_stats.n_upload++;
+    ksgl_stats.sz_upload += len;
+    ksgl_stats.sz_upload_copied += n * sizeof(*idx);
+
+    return true;
+}
+
+/* Returns the largest index in 'buf' (of 'type'), or -1 if it is empty */
+static ks_ssize_t my_maxidx(ksgl_buf* buf, int type) {
+    ks_ssize_t res = -1;
+    ks_size_t i, n = buf->len / ksgl_idxsize(type);
+    for (i = 0; i < n; ++i) {
+        ks_ssize_t v;
+        if (type == GL_UNSIGNED_BYTE) {
+            v = ((nx_u8*)buf->data)[i];
+        } else if (type == GL_UNSIGNED_SHORT) {
+            v = ((nx_u16*)buf->data)[i];
+        } else {
+            v = ((nx_u32*)buf->data)[i];
+        }
+        if (v > res) res = v;
+    }
+
+    return res;
+}
+
 /* C-API */
 
 /* Type Functions */
@@ -17,7 +241,8 @@ static KS_TFUNC(T, free) {
     ksgl_ebo self;
     KS_ARGS("self:*", &self, ksglt_ebo);
 
-    if (self->val >= 0) glDeleteBuffers(1, (GLuint[]){ self->val });
+    /* Recycle the handle, since another buffer of the same size may be created soon */
+    if (self->val >= 0) ksgl_ctx_release(KSGL_OBJ_BUFFER, self->val, self->pool ? (ks_size_t[]){ self->size, self->usage, 0 } : NULL);
 
     KSO_DEL(self);
     return KSO_NONE;
@@ -27,41 +252,88 @@ static KS_TFUNC(T, init) {
     ksgl_ebo self;
     kso data = KSO_NONE;
     ks_cint usage = GL_STATIC_DRAW;
-    KS_ARGS("self:* ?data ?usage:cint", &self, ksglt_ebo, &data, &usage);
+    ks_cint narrow = 0;
+    bool strip = false;
+    KS_ARGS("self:* ?data ?usage:cint ?narrow:cint ?strip:bool", &self, ksglt_ebo, &data, &usage, &narrow, &strip);
 
     self->val = -1;
+    self->size = 0;
+    self->usage = usage;
+    self->idxtype = GL_UNSIGNED_INT;
+    self->num = 0;
+    self->strip = strip;
+    self->pool = true;
 
-    /* Create buffer object */
-    GLuint t;
-    glGenBuffers(1, &t);
-    self->val = t;
-    if (!ksgl_check()) {
+    /* Get the raw indices (without copying, if possible) */
+    ksgl_buf buf;
+    int type;
+    if (!my_getidx(data, narrow, strip, &buf, &type)) {
         return NULL;
     }
 
-    /* Convert the data to its bytes equivalent */
-    ks_bytes data_bytes = kso_bytes(data);
-    if (!data_bytes) {
-        return NULL;
-    }
+    self->size = buf.len;
+    self->idxtype = type;
+    self->num = buf.len / ksgl_idxsize(type);
 
-    /* Bind as the currently used buffer */
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, self->val);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, data_bytes->len_b, data_bytes->data, usage);
+    /* If a VAO was bound explicitly (i.e. 'vao.bind()'), this becomes its element buffer. Otherwise, the copy
+     *   target is used, so that a VAO which was only left bound by drawing it is left alone
+     */
+    bool attach = ksgl_ctx.vao != 0 && !ksgl_ctx.vao_draw;
+    GLenum target = attach ? GL_ELEMENT_ARRAY_BUFFER : GL_COPY_WRITE_BUFFER;
+    if (attach) self->pool = false;
+
+    GLuint t;
+    if (ksgl_ctx_take(KSGL_OBJ_BUFFER, (ks_size_t[]){ self->size, self->usage, 0 }, &t)) {
+        /* Recycled buffer, which already has (new) storage of the right size */
+        self->val = t;
+        glBindBuffer(target, self->val);
+        if (buf.len > 0) glBufferSubData(target, 0, buf.len, buf.data);
+    } else {
+        /* Create buffer object */
+        self->val = ksgl_ctx_gen(KSGL_OBJ_BUFFER);
+
+        glBindBuffer(target, self->val);
+        glBufferData(target, buf.len, buf.data, usage);
+    }
 
-    /* Done with the bytes */
-    KS_DECREF(data_bytes);
+    /* Done with the data */
+    ksgl_buf_done(&buf);
     if (!ksgl_check()) {
         return NULL;
     }
 
     return KSO_NONE;
 }
+static KS_TFUNC(T, getattr) {
+    ksgl_ebo self;
+    ks_str attr;
+    KS_ARGS("self:* attr:*", &self, ksglt_ebo, &attr, kst_str);
+
+    if (ks_str_eq_c(attr, "size", 4)) {
+        return (kso)ks_int_new(self->size);
+    } else if (ks_str_eq_c(attr, "usage", 5)) {
+        return (kso)ks_int_new(self->usage);
+    } else if (ks_str_eq_c(attr, "type", 4)) {
+        return (kso)ks_int_new(self->idxtype);
+    } else if (ks_str_eq_c(attr, "num", 3)) {
+        return (kso)ks_int_new(self->num);
+    } else if (ks_str_eq_c(attr, "strip", 5)) {
+        return KSO_BOOL(self->strip);
+    } else if (ks_str_eq_c(attr, "restart", 7)) {
+        return (kso)ks_int_new(ksgl_idxrestart(self->idxtype));
+    }
+
+    KS_THROW_ATTR(self, attr);
+    return NULL;
+}
+
 static KS_TFUNC(T, bind) {
     ksgl_ebo self;
     KS_ARGS("self:*", &self, ksglt_ebo);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, self->val);
+    /* The current VAO now refers to this handle, without holding a reference */
+    self->pool = false;
+    my_bind(self->val);
     if (!ksgl_check()) {
         return NULL;
     }
@@ -73,7 +345,7 @@ static KS_TFUNC(T, unbind) {
     ksgl_ebo self;
     KS_ARGS("self:*", &self, ksglt_ebo);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    my_bind(0);
     if (!ksgl_check()) {
         return NULL;
     }
@@ -82,6 +354,149 @@ static KS_TFUNC(T, unbind) {
 }
 
 
+static KS_TFUNC(T, write) {
+    ksgl_ebo self;
+    kso data;
+    ks_cint offset = 0;
+    KS_ARGS("self:* data ?offset:cint", &self, ksglt_ebo, &data, &offset);
+
+    /* Get the raw indices (without copying, if they are already the right type) */
+    ksgl_buf buf;
+    if (!my_getidx_as(data, self->idxtype, &buf)) {
+        return NULL;
+    }
+
+    /* The restart index would split a list of triangles (strips may contain it, though) */
+    ks_ssize_t mx = self->strip ? -1 : my_maxidx(&buf, self->idxtype);
+    if (mx >= (ks_ssize_t)ksgl_idxrestart(self->idxtype)) {
+        KS_THROW(kst_SizeError, "Index %i is too large for the index type of the buffer (which can hold up to %i)", (int)mx, (int)ksgl_idxrestart(self->idxtype) - 1);
+        ksgl_buf_done(&buf);
+        return NULL;
+    }
+
+    ks_size_t isz = ksgl_idxsize(self->idxtype);
+    if (offset < 0 || (offset * isz) + buf.len > self->size) {
+        KS_THROW(kst_SizeError, "Writing %i indices at index %i is out of range for a buffer of %i indices", (int)(buf.len / isz), (int)offset, (int)self->num);
+        ksgl_buf_done(&buf);
+        return NULL;
+    }
+
+    /* Bind to the copy target, so that the current VAO's element buffer is left alone */
+    glBindBuffer(GL_COPY_WRITE_BUFFER, self->val);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, offset * isz, buf.len, buf.data);
+    ksgl_buf_done(&buf);
+    if (!ksgl_check()) {
+        return NULL;
+    }
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, read) {
+    ksgl_ebo self;
+    ks_cint num = -1, offset = 0;
+    KS_ARGS("self:* ?num:cint ?offset:cint", &self, ksglt_ebo, &num, &offset);
+
+    if (num < 0) {
+        num = (ks_cint)self->num - offset;
+        if (num < 0) num = 0;
+    }
+    if (offset < 0 || offset + num > self->num) {
+        KS_THROW(kst_SizeError, "Reading %i indices at index %i is out of range for a buffer of %i indices", (int)num, (int)offset, (int)self->num);
+        return NULL;
+    }
+
+    nx_array res = nx_array_newc(nxt_array, NULL, my_nxtype(self->idxtype), 1, (ks_size_t[]){ num }, NULL);
+    if (!res) {
+        return NULL;
+    }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, self->val);
+    if (!ksgl_read_into(GL_COPY_READ_BUFFER, offset * ksgl_idxsize(self->idxtype), res->val)) {
+        KS_DECREF(res);
+        return NULL;
+    }
+
+    return (kso)res;
+}
+
+static KS_TFUNC(T, read_into) {
+    ksgl_ebo self;
+    kso out;
+    ks_cint offset = 0;
+    KS_ARGS("self:* out ?offset:cint", &self, ksglt_ebo, &out, &offset);
+
+    nx_t val;
+    if (!ksgl_getnx(out, &val)) {
+        return NULL;
+    }
+
+    ks_size_t isz = ksgl_idxsize(self->idxtype);
+    if (val.dtype->size != isz) {
+        KS_THROW(kst_TypeError, "Expected an array of %i byte elements, to match the index type", (int)isz);
+        return NULL;
+    }
+
+    ks_size_t len = ksgl_nbytes(val);
+    if (offset < 0 || (offset * isz) + len > self->size) {
+        KS_THROW(kst_SizeError, "Reading %i indices at index %i is out of range for a buffer of %i indices", (int)(len / isz), (int)offset, (int)self->num);
+        return NULL;
+    }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, self->val);
+    if (!ksgl_read_into(GL_COPY_READ_BUFFER, offset * isz, val)) {
+        return NULL;
+    }
+
+    return KS_NEWREF(out);
+}
+
+static KS_TFUNC(T, read_async) {
+    ksgl_ebo self;
+    ks_cint num = -1, offset = 0;
+    ksgl_asyncread handle = NULL;
+    KS_ARGS("self:* ?num:cint ?offset:cint ?handle:*", &self, ksglt_ebo, &num, &offset, &handle, ksglt_asyncread);
+
+    if (num < 0) {
+        num = (ks_cint)self->num - offset;
+        if (num < 0) num = 0;
+    }
+    if (offset < 0 || offset + num > self->num) {
+        KS_THROW(kst_SizeError, "Reading %i indices at index %i is out of range for a buffer of %i indices", (int)num, (int)offset, (int)self->num);
+        return NULL;
+    }
+
+    ks_size_t isz = ksgl_idxsize(self->idxtype);
+    return (kso)ksgl_asyncread_start(self->val, offset * isz, num * isz, handle);
+}
+
+static KS_TFUNC(T, draw) {
+    ksgl_ebo self;
+    ks_cint mode = -1, num = -1, offset = 0;
+    KS_ARGS("self:* ?mode:cint ?num:cint ?offset:cint", &self, ksglt_ebo, &mode, &num, &offset);
+
+    if (offset < 0 || offset > self->num) {
+        KS_THROW(kst_SizeError, "Offset %i is out of range for %i indices", (int)offset, (int)self->num);
+        return NULL;
+    }
+    if (num < 0) num = self->num - offset;
+    if (offset + num > self->num) {
+        KS_THROW(kst_SizeError, "Drawing %i indices at index %i is out of range for a buffer of %i indices", (int)num, (int)offset, (int)self->num);
+        return NULL;
+    }
+    if (mode < 0) mode = self->strip ? GL_TRIANGLE_STRIP : GL_TRIANGLES;
+    if (self->strip) {
+        ksgl_ctx_restart(ksgl_idxrestart(self->idxtype));
+    } else {
+        ksgl_ctx_norestart();
+    }
+
+    glDrawElements(mode, num, self->idxtype, (void*)(offset * ksgl_idxsize(self->idxtype)));
+
+    return KSO_NONE;
+}
+
+
 /* Export */
 
 ks_type ksglt_ebo;
@@ -89,10 +504,18 @@ ks_type ksglt_ebo;
 void _ksgl_ebo() {
     ksglt_ebo = ks_type_new(T_NAME, kst_object, sizeof(struct ksgl_ebo_s), -1, "OpenGL element buffer object (ebo)", KS_IKV(
         {"__free",                 ksf_wrap(T_free_, T_NAME ".__free(self)", "")},
-        {"__init",                 ksf_wrap(T_init_, T_NAME ".__init(self, data='', usage=gl.STATIC_DRAW)", "")},
+        {"__init",                 ksf_wrap(T_init_, T_NAME ".__init(self, data='', usage=gl.STATIC_DRAW, narrow=0, strip=false)", "If a VAO is bound (by 'gl.VAO.bind()'), this becomes its element buffer. If 'narrow' is non-zero, indices are stored in the smallest type of at least 'narrow' bits (8, 16, or 32) that can hold them. If 'strip', 'data' is a list of triangles, which are stored as triangle strips separated by '.restart' (the maximum value of the index type)")},
+        {"__getattr",              ksf_wrap(T_getattr_, T_NAME ".__getattr(self, attr)", "")},
 
         {"bind",                   ksf_wrap(T_bind_, T_NAME ".bind(self)", "Bind this element buffer object as the current one")},
         {"unbind",                 ksf_wrap(T_unbind_, T_NAME ".unbind(self)", "Unbind this element buffer object")},
+
+        {"write",                  ksf_wrap(T_write_, T_NAME ".write(self, data, offset=0)", "Writes indices (converted to the stored index type, if needed) starting at index 'offset'. Indices which don't fit in the stored index type throw a 'SizeError' (as does '.restart', unless this buffer holds strips)")},
+        {"read",                   ksf_wrap(T_read_, T_NAME ".read(self, num=-1, offset=0)", "Reads 'num' indices (default: all) starting at index 'offset', and returns them as an array")},
+        {"read_into",              ksf_wrap(T_read_into_, T_NAME ".read_into(self, out, offset=0)", "Reads indices starting at index 'offset' into an existing array 'out', without allocating if it is dense. Returns 'out'")},
+        {"read_async",             ksf_wrap(T_read_async_, T_NAME ".read_async(self, num=-1, offset=0, handle=none)", "Starts reading indices without stalling, and returns a 'gl.AsyncRead' to collect the data later. If 'handle' is given, its staging storage is reused")},
+
+        {"draw",                   ksf_wrap(T_draw_, T_NAME ".draw(self, mode=-1, num=-1, offset=0)", "Draws 'num' indices (default: all) starting at index 'offset', using the stored index type. If 'mode < 0', it is 'gl.TRIANGLE_STRIP' (with primitive restart) for strips, and 'gl.TRIANGLES' otherwise. The VAO this buffer belongs to must be bound")},
     ));
 }
 
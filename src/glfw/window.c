@@ -54,6 +54,9 @@ static KS_TFUNC(T, init) {
     /* Set current OpenGL context */
     glfwMakeContextCurrent(self->val);
 
+    /* New context, so the cached state doesn't apply */
+    ksgl_ctx_invalidate();
+
     /* 1=vsync, 0=as fast as possible */
     glfwSwapInterval(1);
 
@@ -120,6 +123,9 @@ static KS_TFUNC(T, swap) {
     ksgl_glfw_window self;
     KS_ARGS("self:*", &self, ksgl_glfwt_window);
 
+    /* End of the frame, so delete objects that were freed during it */
+    ksgl_ctx_flush();
+
     glfwSwapBuffers(self->val);
 
     return KSO_NONE;
@@ -142,7 +148,7 @@ void _ksgl_glfw_window() {
     
         {"show",                   ksf_wrap(T_show_, T_NAME ".show(self)", "Shows the window, if it was hidden")},
         {"hide",                   ksf_wrap(T_hide_, T_NAME ".hide(self)", "Hides the window, if it was shown")},
-        {"swap",                   ksf_wrap(T_swap_, T_NAME ".swap(self)", "Swaps the window buffers")},
+        {"swap",                   ksf_wrap(T_swap_, T_NAME ".swap(self)", "Swaps the window buffers (and calls 'gl.end_frame()')")},
     
     ));
 }
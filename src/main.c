@@ -224,7 +224,7 @@ static KS_TFUNC(M, enable) {
     ks_cint cap;
     KS_ARGS("cap:cint", &cap);
 
-    glEnable(cap);
+    ksgl_ctx_enable(cap, true);
 
     return KSO_NONE;
 }
@@ -233,7 +233,26 @@ static KS_TFUNC(M, disable) {
     ks_cint cap;
     KS_ARGS("cap:cint", &cap);
 
-    glDisable(cap);
+    ksgl_ctx_enable(cap, false);
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(M, primitive_restart) {
+    ks_cint idx = 0xFFFFFFFF;
+    KS_ARGS("?idx:cint", &idx);
+
+    if (idx < 0) {
+        ksgl_ctx_enable(GL_PRIMITIVE_RESTART, false);
+    } else {
+        /* Enabled explicitly, so it stays enabled for draws which aren't strips */
+        ksgl_ctx_restart(idx);
+        ksgl_ctx.autorestart = false;
+    }
+
+    if (!ksgl_check()) {
+        return NULL;
+    }
 
     return KSO_NONE;
 }
@@ -257,7 +276,7 @@ static KS_TFUNC(M, clearColor) {
         return NULL;
     }
 
-    glClearColor(val[0], val[1], val[2], val[3]);
+    ksgl_ctx_clearcolor(val[0], val[1], val[2], val[3]);
 
     return KSO_NONE;
 }
@@ -266,7 +285,7 @@ static KS_TFUNC(M, viewport) {
     ks_cint x, y, w, h;
     KS_ARGS("x:cint y:cint w:cint h:cint", &x, &y, &w, &h);
 
-    glViewport(x, y, w, h);    
+    ksgl_ctx_viewport(x, y, w, h);
 
     return KSO_NONE;
 }
@@ -276,7 +295,128 @@ static KS_TFUNC(M, polygon_mode) {
     ks_cint face, mode = GL_FILL;
     KS_ARGS("face:cint ?mode:cint", &face, &mode);
 
-    glPolygonMode(face, mode);
+    if (face == GL_FRONT_AND_BACK) {
+        ksgl_ctx_polygonmode(mode);
+    } else {
+        /* Faces differ, so there is no single mode to cache */
+        glPolygonMode(face, mode);
+        ksgl_ctx.polygonmode = KSGL_UNKNOWN;
+    }
+
+    return KSO_NONE;
+}
+
+
+static KS_TFUNC(M, finish) {
+    KS_ARGS("");
+
+    glFinish();
+
+    return KSO_NONE;
+}
+
+
+static KS_TFUNC(M, invalidate_state) {
+    KS_ARGS("");
+
+    ksgl_ctx_invalidate();
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(M, compile_shaders) {
+    kso srcs;
+    KS_ARGS("srcs", &srcs);
+
+    ks_list lv = ks_list_newi(srcs);
+    if (!lv) {
+        return NULL;
+    }
+
+    /* Submit everything before checking anything, so the driver can work on them together */
+    ks_list res = ks_list_new(0, NULL);
+    int i;
+    for (i = 0; i < lv->len; ++i) {
+        ks_list pair = ks_list_newi(lv->elems[i]);
+        if (!pair) {
+            KS_DECREF(lv);
+            KS_DECREF(res);
+            return NULL;
+        }
+        if (pair->len != 2 || !kso_issub(pair->elems[0]->type, kst_str) || !kso_issub(pair->elems[1]->type, kst_str)) {
+            KS_THROW(kst_TypeError, "Expected '(src_vert, src_frag)' pairs of 'str', but got %R", lv->elems[i]);
+            KS_DECREF(pair);
+            KS_DECREF(lv);
+            KS_DECREF(res);
+            return NULL;
+        }
+
+        ksgl_shader sh = ksgl_shader_submit((ks_str)pair->elems[0], (ks_str)pair->elems[1]);
+        KS_DECREF(pair);
+        if (!sh) {
+            KS_DECREF(lv);
+            KS_DECREF(res);
+            return NULL;
+        }
+
+        ks_list_push(res, (kso)sh);
+        KS_DECREF(sh);
+    }
+
+    KS_DECREF(lv);
+    return (kso)res;
+}
+
+static KS_TFUNC(M, shader_cache) {
+    kso dir = KSO_NONE;
+    KS_ARGS("?dir", &dir);
+
+    if (dir == KSO_NONE) {
+        ksgl_shader_cachedir(NULL);
+    } else if (kso_issub(dir->type, kst_str)) {
+        ksgl_shader_cachedir(((ks_str)dir)->data);
+    } else {
+        KS_THROW(kst_TypeError, "Expected 'dir' to be a 'str' or none, but got '%T'", dir);
+        return NULL;
+    }
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(M, end_frame) {
+    KS_ARGS("");
+
+    ksgl_ctx_flush();
+
+    return KSO_NONE;
+}
+
+
+/*** Statistics ***/
+
+static KS_TFUNC(M, stats) {
+    KS_ARGS("");
+
+    return (kso)ks_dict_new(KS_IKV(
+        {"n_upload",               (kso)ks_int_new(ksgl_stats.n_upload)},
+        {"sz_upload",              (kso)ks_int_new(ksgl_stats.sz_upload)},
+        {"sz_upload_copied",       (kso)ks_int_new(ksgl_stats.sz_upload_copied)},
+        {"n_sync_stall",           (kso)ks_int_new(ksgl_stats.n_sync_stall)},
+        {"n_gen",                  (kso)ks_int_new(ksgl_stats.n_gen)},
+        {"n_recycle",              (kso)ks_int_new(ksgl_stats.n_recycle)},
+        {"n_delete",               (kso)ks_int_new(ksgl_stats.n_delete)},
+        {"n_delete_batch",         (kso)ks_int_new(ksgl_stats.n_delete_batch)},
+        {"n_state_change",         (kso)ks_int_new(ksgl_stats.n_state_change)},
+        {"n_state_skip",           (kso)ks_int_new(ksgl_stats.n_state_skip)},
+        {"n_shader_hit",           (kso)ks_int_new(ksgl_stats.n_shader_hit)},
+        {"n_shader_miss",          (kso)ks_int_new(ksgl_stats.n_shader_miss)},
+    ));
+}
+
+static KS_TFUNC(M, stats_reset) {
+    KS_ARGS("");
+
+    memset(&ksgl_stats, 0, sizeof(ksgl_stats));
 
     return KSO_NONE;
 }
@@ -297,11 +437,166 @@ static KS_TFUNC(M, draw_elements) {
     ks_cint mode, num, type, byteoffset = 0;
     KS_ARGS("mode:cint num:cint type:cint ?byteoffset:cint", &mode, &num, &type, &byteoffset);
 
+    ksgl_ctx_norestart();
     glDrawElements(mode, num, type, (void*)byteoffset);
 
     return KSO_NONE;
 }
 
+/* Get 'n' elements of 'dtype' from each of 'nargs' objects, which must all have the same number of elements */
+static bool my_getmulti(int nargs, kso* args, nx_dtype dtype, ksgl_buf* out, ks_size_t* n) {
+    int i;
+    for (i = 0; i < nargs; ++i) {
+        if (!ksgl_buf_getas(args[i], dtype, &out[i])) {
+            while (--i >= 0) ksgl_buf_done(&out[i]);
+            return false;
+        }
+    }
+
+    *n = out[0].len / dtype->size;
+    for (i = 1; i < nargs; ++i) {
+        if (out[i].len / dtype->size != *n) {
+            KS_THROW(kst_SizeError, "Expected arrays of the same length, but got %i and %i", (int)*n, (int)(out[i].len / dtype->size));
+            for (i = 0; i < nargs; ++i) ksgl_buf_done(&out[i]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Convert byte offsets into the pointers OpenGL expects, returning a temporary array (which should be freed with 'ks_free()') */
+static const void** my_getptrs(ksgl_buf* offsets, ks_size_t n) {
+    const void** res = ks_malloc(sizeof(*res) * (n > 0 ? n : 1));
+    if (!res) {
+        KS_THROW(kst_Error, "Failed to allocate data");
+        return NULL;
+    }
+
+    ks_size_t i;
+    for (i = 0; i < n; ++i) {
+        res[i] = (const void*)(ks_uint)((nx_s64*)offsets->data)[i];
+    }
+
+    return res;
+}
+
+static KS_TFUNC(M, draw_arrays_multi) {
+    ks_cint mode;
+    kso firsts, counts;
+    KS_ARGS("mode:cint firsts counts", &mode, &firsts, &counts);
+
+    ksgl_buf bufs[2];
+    ks_size_t n;
+    if (!my_getmulti(2, (kso[]){ firsts, counts }, nxd_s32, bufs, &n)) {
+        return NULL;
+    }
+
+    glMultiDrawArrays(mode, bufs[0].data, bufs[1].data, n);
+
+    ksgl_buf_done(&bufs[0]);
+    ksgl_buf_done(&bufs[1]);
+    return KSO_NONE;
+}
+
+static KS_TFUNC(M, draw_elements_multi) {
+    ks_cint mode, type;
+    kso counts, byteoffsets;
+    KS_ARGS("mode:cint counts type:cint byteoffsets", &mode, &counts, &type, &byteoffsets);
+
+    ksgl_buf bufs[2];
+    ks_size_t n;
+    if (!my_getmulti(1, &counts, nxd_s32, &bufs[0], &n)) {
+        return NULL;
+    }
+    if (!ksgl_buf_getas(byteoffsets, nxd_s64, &bufs[1])) {
+        ksgl_buf_done(&bufs[0]);
+        return NULL;
+    }
+    if (bufs[1].len / sizeof(nx_s64) != n) {
+        KS_THROW(kst_SizeError, "Expected arrays of the same length, but got %i and %i", (int)n, (int)(bufs[1].len / sizeof(nx_s64)));
+        ksgl_buf_done(&bufs[0]);
+        ksgl_buf_done(&bufs[1]);
+        return NULL;
+    }
+
+    const void** ptrs = my_getptrs(&bufs[1], n);
+    if (ptrs) {
+        ksgl_ctx_norestart();
+        glMultiDrawElements(mode, bufs[0].data, type, ptrs, n);
+        ks_free(ptrs);
+    }
+
+    ksgl_buf_done(&bufs[0]);
+    ksgl_buf_done(&bufs[1]);
+    return ptrs ? KSO_NONE : NULL;
+}
+
+static KS_TFUNC(M, draw_elements_base_vertex) {
+    ks_cint mode, num, type, byteoffset, basevertex;
+    KS_ARGS("mode:cint num:cint type:cint byteoffset:cint basevertex:cint", &mode, &num, &type, &byteoffset, &basevertex);
+
+    ksgl_ctx_norestart();
+    glDrawElementsBaseVertex(mode, num, type, (void*)byteoffset, basevertex);
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(M, draw_elements_multi_base_vertex) {
+    ks_cint mode, type;
+    kso counts, byteoffsets, basevertices;
+    KS_ARGS("mode:cint counts type:cint byteoffsets basevertices", &mode, &counts, &type, &byteoffsets, &basevertices);
+
+    ksgl_buf bufs[3];
+    ks_size_t n;
+    if (!my_getmulti(2, (kso[]){ counts, basevertices }, nxd_s32, bufs, &n)) {
+        return NULL;
+    }
+    if (!ksgl_buf_getas(byteoffsets, nxd_s64, &bufs[2])) {
+        ksgl_buf_done(&bufs[0]);
+        ksgl_buf_done(&bufs[1]);
+        return NULL;
+    }
+    if (bufs[2].len / sizeof(nx_s64) != n) {
+        KS_THROW(kst_SizeError, "Expected arrays of the same length, but got %i and %i", (int)n, (int)(bufs[2].len / sizeof(nx_s64)));
+        ksgl_buf_done(&bufs[0]);
+        ksgl_buf_done(&bufs[1]);
+        ksgl_buf_done(&bufs[2]);
+        return NULL;
+    }
+
+    const void** ptrs = my_getptrs(&bufs[2], n);
+    if (ptrs) {
+        ksgl_ctx_norestart();
+        glMultiDrawElementsBaseVertex(mode, bufs[0].data, type, ptrs, n, bufs[1].data);
+        ks_free(ptrs);
+    }
+
+    ksgl_buf_done(&bufs[0]);
+    ksgl_buf_done(&bufs[1]);
+    ksgl_buf_done(&bufs[2]);
+    return ptrs ? KSO_NONE : NULL;
+}
+
+static KS_TFUNC(M, draw_arrays_instanced) {
+    ks_cint mode, num, instances, offset = 0;
+    KS_ARGS("mode:cint num:cint instances:cint ?offset:cint", &mode, &num, &instances, &offset);
+
+    glDrawArraysInstanced(mode, offset, num, instances);
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(M, draw_elements_instanced) {
+    ks_cint mode, num, type, instances, byteoffset = 0;
+    KS_ARGS("mode:cint num:cint type:cint instances:cint ?byteoffset:cint", &mode, &num, &type, &instances, &byteoffset);
+
+    ksgl_ctx_norestart();
+    glDrawElementsInstanced(mode, num, type, (void*)byteoffset, instances);
+
+    return KSO_NONE;
+}
+
 
 
 
@@ -344,13 +639,27 @@ static ks_module get() {
         return NULL;
     }
 
+    /* Nothing is known about the OpenGL state until it has been set */
+    ksgl_ctx_invalidate();
+
     _ksgl_shader();
+    _ksgl_shadertemplate();
 
     _ksgl_texture2d();
 
     _ksgl_vbo();
+    _ksgl_ubo();
     _ksgl_ebo();
+    _ksgl_streambuf();
+    _ksgl_asyncread();
+    _ksgl_arena();
+    _ksgl_arena_alloc();
     _ksgl_vao();
+    _ksgl_vertexlayout();
+    _ksgl_cmdbuf();
+    _ksgl_renderqueue();
+    _ksgl_pipeline();
+    _ksgl_renderpass();
 
     ks_module res = ks_module_new(M_NAME, "", "OpenGL bindings for kscript", KS_IKV(
 
@@ -367,12 +676,23 @@ static ks_module get() {
         
         /* Types */
         {"Shader",  (kso)ksglt_shader},
+        {"ShaderTemplate",  (kso)ksglt_shadertemplate},
 
         {"Texture2D",  (kso)ksglt_texture2d},
 
         {"EBO",  (kso)ksglt_ebo},
         {"VBO",  (kso)ksglt_vbo},
+        {"UBO",  (kso)ksglt_ubo},
+        {"StreamBuffer",  (kso)ksglt_streambuf},
+        {"AsyncRead",  (kso)ksglt_asyncread},
+        {"BufferArena",  (kso)ksglt_arena},
+        {"ArenaAlloc",  (kso)ksglt_arena_alloc},
         {"VAO",  (kso)ksglt_vao},
+        {"VertexLayout",  (kso)ksglt_vertexlayout},
+        {"CommandBuffer",  (kso)ksglt_cmdbuf},
+        {"RenderQueue",  (kso)ksglt_renderqueue},
+        {"Pipeline",  (kso)ksglt_pipeline},
+        {"RenderPass",  (kso)ksglt_renderpass},
 
         /* Functions */
 
@@ -386,6 +706,7 @@ static ks_module get() {
 
         {"enable",                 ksf_wrap(M_enable_, M_NAME ".enable(cap)", "Enables a feature in OpenGL")},
         {"disable",                ksf_wrap(M_disable_, M_NAME ".disable(cap)", "Disables a feature in OpenGL")},
+        {"primitive_restart",      ksf_wrap(M_primitive_restart_, M_NAME ".primitive_restart(idx=0xFFFFFFFF)", "Enables primitive restart with restart index 'idx' (which should be the maximum value of the index type), or disables it if 'idx < 0'. Strips from 'gl.EBO(..., strip=true)' do this automatically, but strips from 'gl.util.stripify()' or 'gl.ai.Mesh.strip' drawn through other element buffers need it")},
         {"clear",                  ksf_wrap(M_clear_, M_NAME ".clear(flags)", "Clears 'flags' (which should be a bitmask of OpenGL flags)")},
         {"clear_color",            ksf_wrap(M_clearColor_, M_NAME ".clearColor(*args)", "Sets the clear color to '*args', which should be the RGBA components (default: black)")},
 
@@ -393,8 +714,25 @@ static ks_module get() {
 
         {"polygon_mode",           ksf_wrap(M_polygon_mode_, M_NAME "polygon_mode(face, mode=gl.FILL)", "Set the polygon rendering mode")},
 
+        {"finish",                 ksf_wrap(M_finish_, M_NAME ".finish()", "Blocks until all OpenGL commands have completed")},
+
+        {"invalidate_state",       ksf_wrap(M_invalidate_state_, M_NAME ".invalidate_state()", "Forgets the cached OpenGL state (bound objects, enabled capabilities, and the viewport), so that the next call always reaches OpenGL. Call this after using OpenGL outside of these bindings")},
+
+        {"compile_shaders",        ksf_wrap(M_compile_shaders_, M_NAME ".compile_shaders(srcs)", "Starts compiling a list of '(src_vert, src_frag)' pairs, and returns a list of 'gl.Shader's without waiting for them. Errors are raised when a shader is first used, and '.ready' tells whether it has finished (with 'KHR_parallel_shader_compile')")},
+        {"shader_cache",           ksf_wrap(M_shader_cache_, M_NAME ".shader_cache(dir=none)", "Enables the program binary cache in the directory 'dir' (or disables it, if 'dir' is none), so that shaders are loaded from there instead of being compiled, if possible")},
+        {"end_frame",              ksf_wrap(M_end_frame_, M_NAME ".end_frame()", "Deletes objects that were freed since the last call (in batches), and expires unused recycled handles. This is called by 'gl.glfw.Window.swap()', so it only needs to be called when using another windowing library")},
+
+        {"stats",                  ksf_wrap(M_stats_, M_NAME ".stats()", "Returns a dictionary of statistics about the bindings (for example, bytes uploaded and copied)")},
+        {"stats_reset",            ksf_wrap(M_stats_reset_, M_NAME ".stats_reset()", "Resets the statistics returned by 'gl.stats()' to zero")},
+
         {"draw_arrays",            ksf_wrap(M_draw_arrays_, M_NAME ".draw_arrays(mode, num, offset=0)", "Draws primitives from the currently bound vao")},
         {"draw_elements",           ksf_wrap(M_draw_elements_, M_NAME ".draw_elements(mode, num, type, byteoffset=0)", "Draws primitives from the currently bound VAO's EBO")},
+        {"draw_arrays_instanced",  ksf_wrap(M_draw_arrays_instanced_, M_NAME ".draw_arrays_instanced(mode, num, instances, offset=0)", "Draws 'instances' copies of primitives from the currently bound vao")},
+        {"draw_elements_instanced", ksf_wrap(M_draw_elements_instanced_, M_NAME ".draw_elements_instanced(mode, num, type, instances, byteoffset=0)", "Draws 'instances' copies of primitives from the currently bound VAO's EBO")},
+        {"draw_arrays_multi",      ksf_wrap(M_draw_arrays_multi_, M_NAME ".draw_arrays_multi(mode, firsts, counts)", "Draws ranges of primitives from the currently bound vao in a single call, where each range starts at 'firsts[i]' and has 'counts[i]' vertices")},
+        {"draw_elements_multi",    ksf_wrap(M_draw_elements_multi_, M_NAME ".draw_elements_multi(mode, counts, type, byteoffsets)", "Draws ranges of primitives from the currently bound VAO's EBO in a single call, where each range starts at 'byteoffsets[i]' and has 'counts[i]' indices")},
+        {"draw_elements_base_vertex", ksf_wrap(M_draw_elements_base_vertex_, M_NAME ".draw_elements_base_vertex(mode, num, type, byteoffset, basevertex)", "Draws primitives from the currently bound VAO's EBO, adding 'basevertex' to each index")},
+        {"draw_elements_multi_base_vertex", ksf_wrap(M_draw_elements_multi_base_vertex_, M_NAME ".draw_elements_multi_base_vertex(mode, counts, type, byteoffsets, basevertices)", "Draws ranges of primitives from the currently bound VAO's EBO in a single call, where each range starts at 'byteoffsets[i]', has 'counts[i]' indices, and adds 'basevertices[i]' to each index")},
 
     ));
 
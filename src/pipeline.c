@@ -0,0 +1,181 @@
+/* pipeline.c - gl.Pipeline type
+ *
+ * Each piece of state is compared against the cached context state before it is set, so applying
+ *   a pipeline only makes the calls which differ from the previous one (or from whatever was set directly)
+ *
+ * @author: Cade Brown <cade@kscript.org>
+ */
+#include <ksgl.h>
+
+#define T_NAME M_NAME ".Pipeline"
+
+
+/* Internals */
+
+/* Id of the last pipeline created */
+static int my_lastid = 0;
+
+
+/* C-API */
+
+bool ksgl_pipeline_apply(ksgl_pipeline self) {
+    if (self->shader) {
+        if (!ksgl_shader_finish(self->shader)) {
+            return false;
+        }
+        ksgl_ctx_useprogram(self->shader->val);
+    }
+
+    ksgl_ctx_enable(GL_DEPTH_TEST, self->depth_test);
+    if (self->depth_test) ksgl_ctx_depthfunc(self->depth_func);
+    ksgl_ctx_depthmask(self->depth_write);
+
+    ksgl_ctx_enable(GL_BLEND, self->blend);
+    if (self->blend) ksgl_ctx_blendfunc(self->blend_src, self->blend_dst);
+
+    ksgl_ctx_enable(GL_CULL_FACE, self->cull != 0);
+    if (self->cull != 0) ksgl_ctx_cullface(self->cull);
+
+    ksgl_ctx_polygonmode(self->polygon_mode);
+
+    if (self->hasviewport) ksgl_ctx_viewport(self->viewport[0], self->viewport[1], self->viewport[2], self->viewport[3]);
+
+    return true;
+}
+
+
+/* Type Functions */
+
+static KS_TFUNC(T, free) {
+    ksgl_pipeline self;
+    KS_ARGS("self:*", &self, ksglt_pipeline);
+
+    KS_NDECREF(self->shader);
+
+    KSO_DEL(self);
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, init) {
+    ksgl_pipeline self;
+    kso shader = KSO_NONE, viewport = KSO_NONE;
+    bool depth_test = true, depth_write = true, blend = false;
+    ks_cint depth_func = GL_LESS, blend_src = GL_SRC_ALPHA, blend_dst = GL_ONE_MINUS_SRC_ALPHA, cull = 0, polygon_mode = GL_FILL;
+    KS_ARGS("self:* ?shader ?depth_test:bool ?depth_write:bool ?depth_func:cint ?blend:bool ?blend_src:cint ?blend_dst:cint ?cull:cint ?polygon_mode:cint ?viewport",
+        &self, ksglt_pipeline, &shader, &depth_test, &depth_write, &depth_func, &blend, &blend_src, &blend_dst, &cull, &polygon_mode, &viewport);
+
+    self->id = ++my_lastid;
+    self->shader = NULL;
+    if (shader != KSO_NONE) {
+        if (!kso_issub(shader->type, ksglt_shader)) {
+            KS_THROW(kst_TypeError, "Expected 'shader' to be a '%S' or none, but got '%T'", ksglt_shader, shader);
+            return NULL;
+        }
+        KS_INCREF(shader);
+        self->shader = (ksgl_shader)shader;
+    }
+
+    self->depth_test = depth_test;
+    self->depth_write = depth_write;
+    self->depth_func = depth_func;
+    self->blend = blend;
+    self->blend_src = blend_src;
+    self->blend_dst = blend_dst;
+    self->cull = cull;
+    self->polygon_mode = polygon_mode;
+
+    self->hasviewport = viewport != KSO_NONE;
+    if (self->hasviewport && !ksgl_getrect(viewport, self->viewport)) {
+        return NULL;
+    }
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, getattr) {
+    ksgl_pipeline self;
+    ks_str attr;
+    KS_ARGS("self:* attr:*", &self, ksglt_pipeline, &attr, kst_str);
+
+    if (ks_str_eq_c(attr, "id", 2)) {
+        return (kso)ks_int_new(self->id);
+    } else if (ks_str_eq_c(attr, "shader", 6)) {
+        return self->shader ? KS_NEWREF(self->shader) : KSO_NONE;
+    } else if (ks_str_eq_c(attr, "depth_test", 10)) {
+        return KSO_BOOL(self->depth_test);
+    } else if (ks_str_eq_c(attr, "depth_write", 11)) {
+        return KSO_BOOL(self->depth_write);
+    } else if (ks_str_eq_c(attr, "depth_func", 10)) {
+        return (kso)ks_int_new(self->depth_func);
+    } else if (ks_str_eq_c(attr, "blend", 5)) {
+        return KSO_BOOL(self->blend);
+    } else if (ks_str_eq_c(attr, "blend_src", 9)) {
+        return (kso)ks_int_new(self->blend_src);
+    } else if (ks_str_eq_c(attr, "blend_dst", 9)) {
+        return (kso)ks_int_new(self->blend_dst);
+    } else if (ks_str_eq_c(attr, "cull", 4)) {
+        return (kso)ks_int_new(self->cull);
+    } else if (ks_str_eq_c(attr, "polygon_mode", 12)) {
+        return (kso)ks_int_new(self->polygon_mode);
+    } else if (ks_str_eq_c(attr, "viewport", 8)) {
+        if (!self->hasviewport) return KSO_NONE;
+        return (kso)ks_tuple_newn(4, (kso[]){
+            (kso)ks_int_new(self->viewport[0]),
+            (kso)ks_int_new(self->viewport[1]),
+            (kso)ks_int_new(self->viewport[2]),
+            (kso)ks_int_new(self->viewport[3]),
+        });
+    }
+
+    KS_THROW_ATTR(self, attr);
+    return NULL;
+}
+
+static KS_TFUNC(T, setattr) {
+    ksgl_pipeline self;
+    ks_str attr;
+    kso val;
+    KS_ARGS("self:* attr:* val", &self, ksglt_pipeline, &attr, kst_str, &val);
+
+    if (ks_str_eq_c(attr, "viewport", 8)) {
+        if (val == KSO_NONE) {
+            self->hasviewport = false;
+        } else if (ksgl_getrect(val, self->viewport)) {
+            self->hasviewport = true;
+        } else {
+            return NULL;
+        }
+
+        return KSO_NONE;
+    }
+
+    KS_THROW_ATTR(self, attr);
+    return NULL;
+}
+
+static KS_TFUNC(T, apply) {
+    ksgl_pipeline self;
+    KS_ARGS("self:*", &self, ksglt_pipeline);
+
+    if (!ksgl_pipeline_apply(self) || !ksgl_check()) {
+        return NULL;
+    }
+
+    return KSO_NONE;
+}
+
+
+/* Export */
+
+ks_type ksglt_pipeline;
+
+void _ksgl_pipeline() {
+    ksglt_pipeline = ks_type_new(T_NAME, kst_object, sizeof(struct ksgl_pipeline_s), -1, "Bundle of a shader and the fixed-function state (depth, blending, culling, polygon mode, and viewport) used to draw with it", KS_IKV(
+        {"__free",                 ksf_wrap(T_free_, T_NAME ".__free(self)", "")},
+        {"__init",                 ksf_wrap(T_init_, T_NAME ".__init(self, shader=none, depth_test=true, depth_write=true, depth_func=gl.LESS, blend=false, blend_src=gl.SRC_ALPHA, blend_dst=gl.ONE_MINUS_SRC_ALPHA, cull=0, polygon_mode=gl.FILL, viewport=none)", "Creates a pipeline. 'cull' is the face to cull (i.e. 'gl.BACK'), or 0 for no culling. If 'shader' or 'viewport' is none, it is left as it is when applied")},
+        {"__getattr",              ksf_wrap(T_getattr_, T_NAME ".__getattr(self, attr)", "")},
+        {"__setattr",              ksf_wrap(T_setattr_, T_NAME ".__setattr(self, attr, val)", "Only '.viewport' may be set (i.e. when the window is resized)")},
+
+        {"apply",                  ksf_wrap(T_apply_, T_NAME ".apply(self)", "Makes the pipeline's state current, only changing the state which differs from the current state")},
+    ));
+}
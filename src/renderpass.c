@@ -0,0 +1,177 @@
+/* renderpass.c - gl.RenderPass type
+ *
+ * @author: Cade Brown <cade@kscript.org>
+ */
+#include <ksgl.h>
+
+#define T_NAME M_NAME ".RenderPass"
+
+
+/* C-API */
+
+void ksgl_renderpass_begin(ksgl_renderpass self) {
+    ksgl_ctx_bindfbo(self->target);
+    if (self->hasviewport) ksgl_ctx_viewport(self->viewport[0], self->viewport[1], self->viewport[2], self->viewport[3]);
+
+    GLbitfield flags = 0;
+    if (self->hascolor) {
+        ksgl_ctx_clearcolor(self->color[0], self->color[1], self->color[2], self->color[3]);
+        flags |= GL_COLOR_BUFFER_BIT;
+    }
+    if (self->hasdepth) {
+        /* Depth is only cleared if it can be written */
+        ksgl_ctx_depthmask(true);
+        ksgl_ctx_cleardepth(self->depth);
+        flags |= GL_DEPTH_BUFFER_BIT;
+    }
+
+    if (flags) glClear(flags);
+}
+
+
+/* Type Functions */
+
+static KS_TFUNC(T, free) {
+    ksgl_renderpass self;
+    KS_ARGS("self:*", &self, ksglt_renderpass);
+
+    KSO_DEL(self);
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, init) {
+    ksgl_renderpass self;
+    ks_cint target = 0;
+    kso color = KSO_NONE, depth = KSO_NONE, viewport = KSO_NONE;
+    KS_ARGS("self:* ?target:cint ?color ?depth ?viewport", &self, ksglt_renderpass, &target, &color, &depth, &viewport);
+
+    self->target = target;
+
+    self->hascolor = color != KSO_NONE;
+    if (self->hascolor) {
+        ks_list lv = ks_list_newi(color);
+        if (!lv) {
+            return NULL;
+        }
+
+        ks_cfloat val[4];
+        bool ok = ksgl_getcolor(lv->len, lv->elems, val);
+        KS_DECREF(lv);
+        if (!ok) {
+            return NULL;
+        }
+
+        int i;
+        for (i = 0; i < 4; ++i) {
+            self->color[i] = val[i];
+        }
+    }
+
+    self->hasdepth = depth != KSO_NONE;
+    if (self->hasdepth) {
+        ks_cfloat val;
+        if (!kso_get_cf(depth, &val)) {
+            return NULL;
+        }
+        self->depth = val;
+    }
+
+    self->hasviewport = viewport != KSO_NONE;
+    if (self->hasviewport && !ksgl_getrect(viewport, self->viewport)) {
+        return NULL;
+    }
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, getattr) {
+    ksgl_renderpass self;
+    ks_str attr;
+    KS_ARGS("self:* attr:*", &self, ksglt_renderpass, &attr, kst_str);
+
+    if (ks_str_eq_c(attr, "target", 6)) {
+        return (kso)ks_int_new(self->target);
+    } else if (ks_str_eq_c(attr, "color", 5)) {
+        if (!self->hascolor) return KSO_NONE;
+        return (kso)ks_tuple_newn(4, (kso[]){
+            (kso)ks_float_new(self->color[0]),
+            (kso)ks_float_new(self->color[1]),
+            (kso)ks_float_new(self->color[2]),
+            (kso)ks_float_new(self->color[3]),
+        });
+    } else if (ks_str_eq_c(attr, "depth", 5)) {
+        if (!self->hasdepth) return KSO_NONE;
+        return (kso)ks_float_new(self->depth);
+    } else if (ks_str_eq_c(attr, "viewport", 8)) {
+        if (!self->hasviewport) return KSO_NONE;
+        return (kso)ks_tuple_newn(4, (kso[]){
+            (kso)ks_int_new(self->viewport[0]),
+            (kso)ks_int_new(self->viewport[1]),
+            (kso)ks_int_new(self->viewport[2]),
+            (kso)ks_int_new(self->viewport[3]),
+        });
+    }
+
+    KS_THROW_ATTR(self, attr);
+    return NULL;
+}
+
+static KS_TFUNC(T, setattr) {
+    ksgl_renderpass self;
+    ks_str attr;
+    kso val;
+    KS_ARGS("self:* attr:* val", &self, ksglt_renderpass, &attr, kst_str, &val);
+
+    if (ks_str_eq_c(attr, "viewport", 8)) {
+        if (val == KSO_NONE) {
+            self->hasviewport = false;
+        } else if (ksgl_getrect(val, self->viewport)) {
+            self->hasviewport = true;
+        } else {
+            return NULL;
+        }
+
+        return KSO_NONE;
+    }
+
+    KS_THROW_ATTR(self, attr);
+    return NULL;
+}
+
+static KS_TFUNC(T, begin) {
+    ksgl_renderpass self;
+    kso pipeline = KSO_NONE;
+    KS_ARGS("self:* ?pipeline", &self, ksglt_renderpass, &pipeline);
+
+    if (pipeline != KSO_NONE && !kso_issub(pipeline->type, ksglt_pipeline)) {
+        KS_THROW(kst_TypeError, "Expected 'pipeline' to be a '%S' or none, but got '%T'", ksglt_pipeline, pipeline);
+        return NULL;
+    }
+
+    ksgl_renderpass_begin(self);
+    if (pipeline != KSO_NONE && !ksgl_pipeline_apply((ksgl_pipeline)pipeline)) {
+        return NULL;
+    }
+
+    if (!ksgl_check()) {
+        return NULL;
+    }
+
+    return KSO_NONE;
+}
+
+
+/* Export */
+
+ks_type ksglt_renderpass;
+
+void _ksgl_renderpass() {
+    ksglt_renderpass = ks_type_new(T_NAME, kst_object, sizeof(struct ksgl_renderpass_s), -1, "Target framebuffer of a pass, and the values it is cleared to when the pass begins", KS_IKV(
+        {"__free",                 ksf_wrap(T_free_, T_NAME ".__free(self)", "")},
+        {"__init",                 ksf_wrap(T_init_, T_NAME ".__init(self, target=0, color=none, depth=none, viewport=none)", "Creates a render pass drawing to framebuffer 'target' (0 is the window). The color buffer is cleared to 'color' (RGBA) and the depth buffer to 'depth', unless they are none")},
+        {"__getattr",              ksf_wrap(T_getattr_, T_NAME ".__getattr(self, attr)", "")},
+        {"__setattr",              ksf_wrap(T_setattr_, T_NAME ".__setattr(self, attr, val)", "Only '.viewport' may be set (i.e. when the window is resized)")},
+
+        {"begin",                  ksf_wrap(T_begin_, T_NAME ".begin(self, pipeline=none)", "Binds the target, sets the viewport, and clears it, then applies 'pipeline' (if given). Only the state which differs from the current state is changed")},
+    ));
+}
@@ -0,0 +1,322 @@
+/* renderqueue.c - gl.RenderQueue type
+ *
+ * Items are sorted by a 64 bit key, which packs the state they need. For opaque items, the key is:
+ *
+ *   [pipeline:12][texture:12][vao:16][depth:24]
+ *
+ * so that items with the same state are drawn together (and front-to-back within them). For transparent
+ *   items, the depth comes first (and is inverted), so that they are drawn back-to-front:
+ *
+ *   [~depth:24][pipeline:12][texture:12][vao:16]
+ *
+ * OpenGL handles are used as the ids, since they are small integers. The pipeline field is the id of
+ *   the 'gl.Pipeline' (with the top bit set), or the program handle if only a shader was given
+ *
+ * @author: Cade Brown <cade@kscript.org>
+ */
+#include <ksgl.h>
+
+#define T_NAME M_NAME ".RenderQueue"
+
+
+/* Internals */
+
+/* Convert 'depth' into an integer which sorts in the same order, keeping the top 24 bits */
+static ks_uint my_depthkey(float depth) {
+    union {
+        float f;
+        uint32_t u;
+    } v;
+    v.f = depth;
+
+    /* Flip negative numbers entirely, and set the sign bit of positive numbers */
+    v.u = (v.u & 0x80000000) ? ~v.u : (v.u | 0x80000000);
+    return v.u >> 8;
+}
+
+/* Sort 'n' items by key (with a stable LSD radix sort, 8 bits at a time) */
+static void my_sort(struct ksgl_rq_item* items, int n) {
+    struct ksgl_rq_item* tmp = ks_zmalloc(sizeof(*tmp), n);
+    struct ksgl_rq_item* src = items, *dst = tmp;
+
+    int pass;
+    for (pass = 0; pass < 8; ++pass) {
+        int shift = 8 * pass;
+        ks_size_t count[256] = {0};
+
+        int i;
+        for (i = 0; i < n; ++i) {
+            count[(src[i].key >> shift) & 0xFF]++;
+        }
+
+        /* Skip passes where every key has the same byte */
+        if (count[(src[0].key >> shift) & 0xFF] == n) continue;
+
+        ks_size_t pos = 0;
+        for (i = 0; i < 256; ++i) {
+            ks_size_t c = count[i];
+            count[i] = pos;
+            pos += c;
+        }
+        for (i = 0; i < n; ++i) {
+            dst[count[(src[i].key >> shift) & 0xFF]++] = src[i];
+        }
+
+        struct ksgl_rq_item* t = src;
+        src = dst;
+        dst = t;
+    }
+
+    if (src != items) {
+        memcpy(items, src, sizeof(*items) * n);
+    }
+    ks_free(tmp);
+}
+
+/* Remove all items */
+static void my_clear(ksgl_renderqueue self) {
+    self->nitems = 0;
+    self->ntexs = 0;
+    self->nunis = 0;
+    ks_list_clear(self->objs);
+}
+
+
+/* C-API */
+
+/* Type Functions */
+
+static KS_TFUNC(T, free) {
+    ksgl_renderqueue self;
+    KS_ARGS("self:*", &self, ksglt_renderqueue);
+
+    ks_free(self->items);
+    ks_free(self->texs);
+    ks_free(self->unis);
+    KS_NDECREF(self->objs);
+
+    KSO_DEL(self);
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, init) {
+    ksgl_renderqueue self;
+    bool transparent = false;
+    KS_ARGS("self:* ?transparent:bool", &self, ksglt_renderqueue, &transparent);
+
+    self->transparent = transparent;
+    self->nitems = 0;
+    self->items = NULL;
+    self->ntexs = 0;
+    self->texs = NULL;
+    self->nunis = 0;
+    self->unis = NULL;
+    self->objs = ks_list_new(0, NULL);
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, getattr) {
+    ksgl_renderqueue self;
+    ks_str attr;
+    KS_ARGS("self:* attr:*", &self, ksglt_renderqueue, &attr, kst_str);
+
+    if (ks_str_eq_c(attr, "transparent", 11)) {
+        return KSO_BOOL(self->transparent);
+    } else if (ks_str_eq_c(attr, "nitems", 6)) {
+        return (kso)ks_int_new(self->nitems);
+    }
+
+    KS_THROW_ATTR(self, attr);
+    return NULL;
+}
+
+static KS_TFUNC(T, push) {
+    ksgl_renderqueue self;
+    kso state;
+    ksgl_vao vao;
+    ks_cfloat depth = 0.0;
+    kso textures = KSO_NONE, uniforms = KSO_NONE;
+    ks_cint instances = -1;
+    KS_ARGS("self:* state vao:* ?depth:cfloat ?textures ?uniforms ?instances:cint", &self, ksglt_renderqueue, &state, &vao, ksglt_vao, &depth, &textures, &uniforms, &instances);
+
+    ksgl_pipeline pipeline = NULL;
+    ksgl_shader shader;
+    if (kso_issub(state->type, ksglt_pipeline)) {
+        pipeline = (ksgl_pipeline)state;
+        shader = pipeline->shader;
+        if (!shader) {
+            KS_THROW(kst_Error, "Pipelines given to 'push()' must have a shader");
+            return NULL;
+        }
+    } else if (kso_issub(state->type, ksglt_shader)) {
+        shader = (ksgl_shader)state;
+    } else {
+        KS_THROW(kst_TypeError, "Expected a '%S' or '%S', but got '%T'", ksglt_pipeline, ksglt_shader, state);
+        return NULL;
+    }
+
+    if (!ksgl_shader_finish(shader)) {
+        return NULL;
+    }
+
+    int tex = self->ntexs, ntex = 0;
+    if (textures != KSO_NONE) {
+        ks_list lv = ks_list_newi(textures);
+        if (!lv) {
+            return NULL;
+        }
+        if (lv->len > KSGL_MAXUNITS) {
+            KS_THROW(kst_SizeError, "Too many textures (max: %i)", KSGL_MAXUNITS);
+            KS_DECREF(lv);
+            return NULL;
+        }
+
+        int i;
+        for (i = 0; i < lv->len; ++i) {
+            if (!kso_issub(lv->elems[i]->type, ksglt_texture2d)) {
+                KS_THROW(kst_TypeError, "Expected textures to be '%S', but got '%T'", ksglt_texture2d, lv->elems[i]);
+                KS_DECREF(lv);
+                return NULL;
+            }
+        }
+
+        ntex = lv->len;
+        self->texs = ks_zrealloc(self->texs, sizeof(*self->texs), self->ntexs + ntex);
+        for (i = 0; i < ntex; ++i) {
+            self->texs[self->ntexs++] = ((ksgl_texture2d)lv->elems[i])->val;
+            ks_list_push(self->objs, lv->elems[i]);
+        }
+        KS_DECREF(lv);
+    }
+
+    int uni = self->nunis, nuni = 0;
+    if (uniforms != KSO_NONE) {
+        if (!kso_issub(uniforms->type, kst_dict)) {
+            KS_THROW(kst_TypeError, "Expected 'uniforms' to be a 'dict', but got '%T'", uniforms);
+            self->ntexs = tex;
+            return NULL;
+        }
+
+        ks_dict d = (ks_dict)uniforms;
+        ks_size_t i;
+        for (i = 0; i < d->len_ents; ++i) {
+            kso k = d->ents[i].key;
+            if (!k) continue;
+            if (!kso_issub(k->type, kst_str)) {
+                KS_THROW(kst_TypeError, "Expected uniform names to be 'str', but got '%T'", k);
+                self->ntexs = tex;
+                self->nunis = uni;
+                return NULL;
+            }
+
+            int pos = ksgl_shader_uniformloc(shader, (ks_str)k);
+            if (pos < 0) {
+                self->ntexs = tex;
+                self->nunis = uni;
+                return NULL;
+            }
+
+            self->unis = ks_zrealloc(self->unis, sizeof(*self->unis), self->nunis + 1);
+            struct ksgl_rq_uniform* u = &self->unis[self->nunis];
+            u->pos = pos;
+            if (!ksgl_uniform_get(d->ents[i].val, &u->val)) {
+                self->ntexs = tex;
+                self->nunis = uni;
+                return NULL;
+            }
+            self->nunis++;
+            nuni++;
+        }
+    }
+
+    ks_list_push(self->objs, state);
+    ks_list_push(self->objs, (kso)vao);
+
+    self->items = ks_zrealloc(self->items, sizeof(*self->items), self->nitems + 1);
+    struct ksgl_rq_item* it = &self->items[self->nitems++];
+    it->pipeline = pipeline;
+    it->shader = shader;
+    it->vao = vao;
+    it->instances = instances;
+    it->tex = tex;
+    it->ntex = ntex;
+    it->uni = uni;
+    it->nuni = nuni;
+
+    ks_uint pid = pipeline ? 0x800 | (pipeline->id & 0x7FF) : (shader->val & 0x7FF);
+    ks_uint skey = (pid << 28) | ((ks_uint)((ntex > 0 ? self->texs[tex] : 0) & 0xFFF) << 16) | (ks_uint)(vao->val & 0xFFFF);
+    ks_uint dkey = my_depthkey(depth);
+    if (self->transparent) {
+        it->key = ((~dkey & 0xFFFFFF) << 40) | skey;
+    } else {
+        it->key = (skey << 24) | dkey;
+    }
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, clear) {
+    ksgl_renderqueue self;
+    KS_ARGS("self:*", &self, ksglt_renderqueue);
+
+    my_clear(self);
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, submit) {
+    ksgl_renderqueue self;
+    bool clear = true;
+    KS_ARGS("self:* ?clear:bool", &self, ksglt_renderqueue, &clear);
+
+    if (self->nitems > 1) my_sort(self->items, self->nitems);
+
+    /* Binds which are already current are skipped by the state cache */
+    int i, j;
+    for (i = 0; i < self->nitems; ++i) {
+        struct ksgl_rq_item* it = &self->items[i];
+        if (it->pipeline) {
+            if (!ksgl_pipeline_apply(it->pipeline)) {
+                return NULL;
+            }
+        } else {
+            ksgl_ctx_useprogram(it->shader->val);
+        }
+        for (j = 0; j < it->ntex; ++j) {
+            ksgl_ctx_bindtex(j, self->texs[it->tex + j]);
+        }
+        for (j = 0; j < it->nuni; ++j) {
+            ksgl_uniform_set(self->unis[it->uni + j].pos, &self->unis[it->uni + j].val);
+        }
+
+        if (!ksgl_vao_draw(it->vao, it->instances)) {
+            return NULL;
+        }
+    }
+
+    if (clear) my_clear(self);
+
+    if (!ksgl_check()) {
+        return NULL;
+    }
+
+    return KSO_NONE;
+}
+
+
+/* Export */
+
+ks_type ksglt_renderqueue;
+
+void _ksgl_renderqueue() {
+    ksglt_renderqueue = ks_type_new(T_NAME, kst_object, sizeof(struct ksgl_renderqueue_s), -1, "Queue of draws, which are sorted (by pipeline, texture, VAO, and depth) to minimize state changes", KS_IKV(
+        {"__free",                 ksf_wrap(T_free_, T_NAME ".__free(self)", "")},
+        {"__init",                 ksf_wrap(T_init_, T_NAME ".__init(self, transparent=false)", "Creates an empty queue. Opaque queues group items by state and draw front-to-back, and transparent queues draw back-to-front")},
+        {"__getattr",              ksf_wrap(T_getattr_, T_NAME ".__getattr(self, attr)", "")},
+
+        {"push",                   ksf_wrap(T_push_, T_NAME ".push(self, state, vao, depth=0.0, textures=none, uniforms=none, instances=-1)", "Adds a draw of 'vao' with 'state' (a 'gl.Pipeline', which is applied, or a 'gl.Shader', which leaves the rest of the state as it is), binding 'textures' (a list) to units 0, 1, ... and setting 'uniforms' (a dict of names to values) first. 'depth' is the distance from the camera")},
+        {"clear",                  ksf_wrap(T_clear_, T_NAME ".clear(self)", "Removes every item")},
+        {"submit",                 ksf_wrap(T_submit_, T_NAME ".submit(self, clear=true)", "Sorts the items, and draws them. If 'clear', the queue is emptied afterwards")},
+    ));
+}
@@ -12,24 +12,340 @@
 /* Maximum size of information log */
 #define KSGL_INFOLOG_MAX 1024
 
-/* C-API */
+/* Magic bytes at the start of entries in the program binary cache (changed if the format changes) */
+#define KSGL_BINARY_MAGIC "ksglpb01"
 
-/* Type Functions */
+/* Directory of the program binary cache (or NULL if it is disabled) */
+static char* my_cachedir = NULL;
 
-static KS_TFUNC(T, free) {
-    ksgl_shader self;
-    KS_ARGS("self:*", &self, ksglt_shader);
+/* Whether program binaries are supported (-1 if not checked yet) */
+static int my_has_binary = -1;
 
-    if (self->val >= 0) glDeleteProgram(self->val);
+/* Header of an entry in the program binary cache, which is followed by 'len' bytes of the binary */
+struct my_binhdr {
 
-    KSO_DEL(self);
-    return KSO_NONE;
+    /* KSGL_BINARY_MAGIC */
+    char magic[8];
+
+    /* Key that the entry was stored with (which is checked, in case of a collision in the file name) */
+    uint64_t key;
+
+    /* Format of the binary (from 'glGetProgramBinary()'), and its length */
+    uint32_t format, len;
+
+};
+
+/* Hash 'len' bytes of 'data' into 'h' (FNV-1a, which is stable across runs) */
+static uint64_t my_fnv(uint64_t h, const void* data, ks_size_t len) {
+    const unsigned char* p = data;
+    ks_size_t i;
+    for (i = 0; i < len; ++i) {
+        h = (h ^ p[i]) * 0x100000001B3ULL;
+    }
+
+    return h;
+}
+
+/* Compute the key of a program with the given sources, which also depends on the driver (since binaries
+ *   are only valid for the driver that created them)
+ */
+static uint64_t my_binkey(int nsrcs, ks_str* srcs) {
+    uint64_t h = 0xCBF29CE484222325ULL;
+
+    GLenum strs[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    int i;
+    for (i = 0; i < 3; ++i) {
+        const char* s = (const char*)glGetString(strs[i]);
+        if (s) h = my_fnv(h, s, strlen(s) + 1);
+    }
+
+    for (i = 0; i < nsrcs; ++i) {
+        /* Include the length, so that moving text between sources changes the key */
+        uint64_t len = srcs[i]->len_b;
+        h = my_fnv(h, &len, sizeof(len));
+        h = my_fnv(h, srcs[i]->data, srcs[i]->len_b);
+    }
+
+    return h;
+}
+
+/* Get the path of the cache entry for 'key' */
+static ks_str my_binpath(uint64_t key) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+    return ks_fmt("%s/%s", my_cachedir, name);
+}
+
+/* Returns whether the program binary cache is enabled (and supported) */
+static bool my_usecache() {
+    if (!my_cachedir) return false;
+
+    if (my_has_binary < 0) {
+        GLint n = 0;
+        if (ksgl_hasver(4, 1) || ksgl_hasext("GL_ARB_get_program_binary")) {
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &n);
+        }
+        my_has_binary = n > 0;
+    }
+
+    return my_has_binary;
+}
+
+/* Whether 'KHR_parallel_shader_compile' is available (-1 if not checked yet) */
+static int my_has_parallel = -1;
+
+/* Returns whether shaders are compiled in parallel (with 'KHR_parallel_shader_compile'), which is enabled
+ *   the first time this is called
+ */
+static bool my_parallel() {
+    if (my_has_parallel < 0) {
+        my_has_parallel = 0;
+        if (ksgl_hasext("GL_KHR_parallel_shader_compile")) {
+            /* Not loaded by gl3w, since it is an extension */
+            PFNGLMAXSHADERCOMPILERTHREADSKHRPROC f = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)gl3wGetProcAddress("glMaxShaderCompilerThreadsKHR");
+            if (f) {
+                /* Let the driver choose the number of threads */
+                f(0xFFFFFFFF);
+                my_has_parallel = 1;
+            }
+        }
+    }
+
+    return my_has_parallel;
+}
+
+/* Create a program from the cache entry for 'key', or return -1 if there is no valid entry */
+static int my_binload(uint64_t key) {
+    ks_str path = my_binpath(key);
+    FILE* fp = fopen(path->data, "rb");
+    KS_DECREF(path);
+    if (!fp) {
+        ksgl_stats.n_shader_miss++;
+        return -1;
+    }
+
+    struct my_binhdr hdr;
+    void* data = NULL;
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 || memcmp(hdr.magic, KSGL_BINARY_MAGIC, 8) != 0 || hdr.key != key
+        || !(data = ks_malloc(hdr.len > 0 ? hdr.len : 1)) || fread(data, 1, hdr.len, fp) != hdr.len) {
+        fclose(fp);
+        ks_free(data);
+        ksgl_stats.n_shader_miss++;
+        return -1;
+    }
+    fclose(fp);
+
+    int prog = glCreateProgram();
+    glProgramBinary(prog, hdr.format, data, hdr.len);
+    ks_free(data);
+
+    /* The driver may reject the binary (i.e. after an update), in which case it is compiled again */
+    GLint success = 0;
+    if (glGetError() == GL_NO_ERROR) {
+        glGetProgramiv(prog, GL_LINK_STATUS, &success);
+    }
+    if (!success) {
+        glDeleteProgram(prog);
+        ksgl_stats.n_shader_miss++;
+        return -1;
+    }
+
+    ksgl_stats.n_shader_hit++;
+    return prog;
+}
+
+/* Store the binary of (linked) program 'prog' as the cache entry for 'key'. This is best-effort, so
+ *   failures are ignored
+ */
+static void my_binstore(int prog, uint64_t key) {
+    GLint len = 0;
+    glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &len);
+    if (len <= 0) return;
+
+    struct my_binhdr hdr;
+    void* data = ks_malloc(len);
+    if (!data) return;
+
+    GLsizei rlen = 0;
+    GLenum format = 0;
+    glGetProgramBinary(prog, len, &rlen, &format, data);
+    if (glGetError() != GL_NO_ERROR || rlen <= 0) {
+        ks_free(data);
+        return;
+    }
+
+    memcpy(hdr.magic, KSGL_BINARY_MAGIC, 8);
+    hdr.key = key;
+    hdr.format = format;
+    hdr.len = rlen;
+
+    /* Write to a temporary file, then rename it, so that other processes never see a partial entry */
+    ks_str path = my_binpath(key);
+    ks_str tmp = ks_fmt("%S.tmp", path);
+    FILE* fp = fopen(tmp->data, "wb");
+    if (fp) {
+        bool ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1 && fwrite(data, 1, rlen, fp) == (size_t)rlen;
+        ok = fclose(fp) == 0 && ok;
+        if (!ok || rename(tmp->data, path->data) != 0) remove(tmp->data);
+    }
+
+    KS_DECREF(path);
+    KS_DECREF(tmp);
+    ks_free(data);
+}
+
+/* Find the index of the uniform 'name' in the table of 'self', or -1 if it is not there */
+static int my_ufind(ksgl_shader self, ks_str name) {
+    if (self->ucap == 0) return -1;
+
+    int mask = self->ucap - 1;
+    int i = name->v_hash & mask;
+    while (self->utab[i] >= 0) {
+        ks_str k = self->uniforms[self->utab[i]].name;
+        if (k->v_hash == name->v_hash && k->len_b == name->len_b && memcmp(k->data, name->data, k->len_b) == 0) {
+            return self->utab[i];
+        }
+        i = (i + 1) & mask;
+    }
+
+    return -1;
+}
+
+/* Add a uniform to the table of 'self' (which takes a reference to 'name') */
+static void my_uadd(ksgl_shader self, ks_str name, GLint pos, GLenum type, GLint size) {
+    int idx = self->nuniforms++;
+    self->uniforms = ks_zrealloc(self->uniforms, sizeof(*self->uniforms), self->nuniforms);
+    self->uniforms[idx].name = name;
+    self->uniforms[idx].pos = pos;
+    self->uniforms[idx].type = type;
+    self->uniforms[idx].size = size;
+
+    int i, mask;
+    if (2 * self->nuniforms > self->ucap) {
+        /* Grow, and re-insert everything */
+        self->ucap = self->ucap == 0 ? 16 : 2 * self->ucap;
+        self->utab = ks_zrealloc(self->utab, sizeof(*self->utab), self->ucap);
+        for (i = 0; i < self->ucap; ++i) {
+            self->utab[i] = -1;
+        }
+
+        mask = self->ucap - 1;
+        int j;
+        for (j = 0; j < self->nuniforms; ++j) {
+            i = self->uniforms[j].name->v_hash & mask;
+            while (self->utab[i] >= 0) i = (i + 1) & mask;
+            self->utab[i] = j;
+        }
+    } else {
+        mask = self->ucap - 1;
+        i = name->v_hash & mask;
+        while (self->utab[i] >= 0) i = (i + 1) & mask;
+        self->utab[i] = idx;
+    }
 }
 
+/* Add every active uniform of the (linked) program to the table of 'self'
+ *
+ * Arrays are added both by their name ('x') and the name of their first element ('x[0]'). Other 
+ *   elements and members are added when they are first looked up
+ */
+static bool my_reflect(ksgl_shader self) {
+    GLint n = 0, maxlen = 0;
+    glGetProgramiv(self->val, GL_ACTIVE_UNIFORMS, &n);
+    glGetProgramiv(self->val, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxlen);
+
+    char* buf = ks_malloc(maxlen + 1);
+    if (!buf) {
+        KS_THROW(kst_Error, "Failed to allocate data");
+        return false;
+    }
+
+    GLint i;
+    for (i = 0; i < n; ++i) {
+        GLsizei len = 0;
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(self->val, i, maxlen + 1, &len, &size, &type, buf);
 
+        /* Members of uniform blocks don't have locations */
+        GLint pos = glGetUniformLocation(self->val, buf);
+        if (pos < 0) continue;
+
+        my_uadd(self, ks_str_new(len, buf), pos, type, size);
+        if (len > 3 && strcmp(buf + len - 3, "[0]") == 0) {
+            my_uadd(self, ks_str_new(len - 3, buf), pos, type, size);
+        }
+    }
+
+    ks_free(buf);
+    return ksgl_check();
+}
+
+/* Set the uniform at location 'pos' to the 'm' by 'n' matrix (or vector, if 'm' or 'n' is 1) 'f', which is dense and row-major */
+static void my_setf(int pos, int m, int n, const GLfloat* f) {
+    if (m == 1 || n == 1) {
+        /* Vector (either a row or a column) */
+        int k = m * n;
+        if (k == 1) {
+            glUniform1fv(pos, 1, f);
+        } else if (k == 2) {
+            glUniform2fv(pos, 1, f);
+        } else if (k == 3) {
+            glUniform3fv(pos, 1, f);
+        } else {
+            glUniform4fv(pos, 1, f);
+        }
+    } else if (m == 2) {
+        if (n == 2) {
+            glUniformMatrix2fv(pos, 1, GL_TRUE, f);
+        } else if (n == 3) {
+            glUniformMatrix2x3fv(pos, 1, GL_TRUE, f);
+        } else {
+            glUniformMatrix2x4fv(pos, 1, GL_TRUE, f);
+        }
+    } else if (m == 3) {
+        if (n == 2) {
+            glUniformMatrix3x2fv(pos, 1, GL_TRUE, f);
+        } else if (n == 3) {
+            glUniformMatrix3fv(pos, 1, GL_TRUE, f);
+        } else {
+            glUniformMatrix3x4fv(pos, 1, GL_TRUE, f);
+        }
+    } else {
+        if (n == 2) {
+            glUniformMatrix4x2fv(pos, 1, GL_TRUE, f);
+        } else if (n == 3) {
+            glUniformMatrix4x3fv(pos, 1, GL_TRUE, f);
+        } else {
+            glUniformMatrix4fv(pos, 1, GL_TRUE, f);
+        }
+    }
+}
+
+/* Get the location of 'name' (a location, or the name of a uniform of 'self') */
+static int my_getloc(ksgl_shader self, kso name) {
+    if (kso_is_int(name)) {
+        ks_cint v;
+        if (!ksgl_shader_finish(self) || !kso_get_ci(name, &v)) {
+            return -1;
+        }
+        if (v < 0) {
+            KS_THROW(kst_Error, "Invalid uniform location: %i", (int)v);
+            return -1;
+        }
+        return v;
+    } else if (kso_issub(name->type, kst_str)) {
+        return ksgl_shader_uniformloc(self, (ks_str)name);
+    }
+
+    KS_THROW(kst_TypeError, "Expected uniform to be a name or a location, but got '%T'", name);
+    return -1;
+}
 
 /* Internal compilation, which takes a kind (GL_VERTEX_SHADER, etc),
  *   source
+ *
+ * The status isn't checked here (see 'check_shader()'), so the driver may keep compiling in the background
  */
 static int compile_shader(int kind, ks_str src) {
     /* Create shader */
@@ -38,11 +354,13 @@ static int compile_shader(int kind, ks_str src) {
         (const char*)src->data 
     }, NULL);
     glCompileShader(sh);
-    if (!ksgl_check()) {
-        glDeleteShader(sh);
-        return -1;
-    }
 
+    return sh;
+}
+
+/* Check whether shader 'sh' compiled, returning NULL if it did, or the error message if it didn't
+ */
+static ks_str check_shader(int kind, int sh) {
     /* Check success status */
     int success;
     glGetShaderiv(sh, GL_COMPILE_STATUS, &success);
@@ -51,44 +369,38 @@ static int compile_shader(int kind, ks_str src) {
         char infolog[KSGL_INFOLOG_MAX];
         glGetShaderInfoLog(sh, KSGL_INFOLOG_MAX, NULL, infolog);
 
-        /* Delete the shader */
-        glDeleteShader(sh);
-
-        /* Throw */
-        KS_THROW(kst_Error, "Compiling '%s' shader failed: %s", kind == GL_VERTEX_SHADER ? "vertex" : (kind == GL_FRAGMENT_SHADER ? "fragment" : "unknown"), infolog);
-        return -1;
+        return ks_fmt("Compiling '%s' shader failed: %s", kind == GL_VERTEX_SHADER ? "vertex" : (kind == GL_FRAGMENT_SHADER ? "fragment" : "unknown"), infolog);
     }
 
-    return sh;
+    return NULL;
 }
 
 
 /* Internal program maker, from a list of shaders
+ *
+ * If 'retrievable', the driver is told that its binary will be retrieved (for the cache). The status isn't 
+ *   checked here (see 'check_program()')
  */
-static int make_program(int nshaders, int* shaders) {
+static int make_program(int nshaders, int* shaders, bool retrievable) {
     /* Create complete shader program */
     int prog = glCreateProgram();
-    if (!ksgl_check()) {
-        glDeleteProgram(prog);
-        return -1;
-    }
+
+    if (retrievable) glProgramParameteri(prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 
     /* Attach all prts */
     int i;
     for (i = 0; i < nshaders; ++i) {
         glAttachShader(prog, shaders[i]);
-        if (!ksgl_check()) {
-            glDeleteProgram(prog);
-            return -1;
-        }
     }
 
     glLinkProgram(prog);
-    if (!ksgl_check()) {
-        glDeleteProgram(prog);
-        return -1;
-    }
 
+    return prog;
+}
+
+/* Check whether program 'prog' linked, returning NULL if it did, or the error message if it didn't
+ */
+static ks_str check_program(int prog) {
     /* Check status */
     int success;
     glGetProgramiv(prog, GL_LINK_STATUS, &success);
@@ -97,52 +409,310 @@ static int make_program(int nshaders, int* shaders) {
         char infolog[KSGL_INFOLOG_MAX];
         glGetProgramInfoLog(prog, KSGL_INFOLOG_MAX, NULL, infolog);
 
-        /* Delete program */
-        glDeleteProgram(prog);
+        return ks_fmt("Linking shader failed: %s", infolog);
+    }
+
+    return NULL;
+}
+
+/* Start compiling and linking 'self' (or load it from the program binary cache), without waiting for
+ *   the result, which is checked by 'ksgl_shader_finish()'
+ */
+static bool my_submit(ksgl_shader self, ks_str src_vert, ks_str src_frag) {
+    self->val = -1;
+    self->nuniforms = 0;
+    self->uniforms = NULL;
+    self->ucap = 0;
+    self->utab = NULL;
+    self->pending = false;
+    self->err = NULL;
+    self->cache = false;
+    self->key = 0;
+
+    /* Try the program binary cache first */
+    bool usecache = my_usecache();
+    if (usecache) {
+        self->key = my_binkey(2, (ks_str[]){ src_vert, src_frag });
+        self->val = my_binload(self->key);
+        if (self->val >= 0) {
+            return my_reflect(self);
+        }
+    }
+
+    my_parallel();
 
-        /* Throw */
-        KS_THROW(kst_Error, "Linking shader failed: %s", infolog);
+    self->pend[0] = compile_shader(GL_VERTEX_SHADER, src_vert);
+    self->pend[1] = compile_shader(GL_FRAGMENT_SHADER, src_frag);
+    self->val = make_program(2, self->pend, usecache);
+    self->pending = true;
+    self->cache = usecache;
+
+    return ksgl_check();
+}
+
+/* C-API */
+
+void ksgl_shader_cachedir(const char* dir) {
+    ks_free(my_cachedir);
+    my_cachedir = NULL;
+    if (dir) {
+        ks_size_t len = strlen(dir);
+        my_cachedir = ks_malloc(len + 1);
+        if (my_cachedir) memcpy(my_cachedir, dir, len + 1);
+    }
+}
+
+ksgl_shader ksgl_shader_submit(ks_str src_vert, ks_str src_frag) {
+    ksgl_shader res = KSO_NEW(ksgl_shader, ksglt_shader);
+    if (!my_submit(res, src_vert, src_frag)) {
+        KS_DECREF(res);
+        return NULL;
+    }
+
+    return res;
+}
+
+bool ksgl_shader_finish(ksgl_shader self) {
+    if (self->err) {
+        KS_THROW(kst_Error, "%S", self->err);
+        return false;
+    }
+    if (!self->pending) {
+        return true;
+    }
+
+    /* This waits for the driver, if it is still compiling */
+    self->pending = false;
+    ks_str err = check_shader(GL_VERTEX_SHADER, self->pend[0]);
+    if (!err) err = check_shader(GL_FRAGMENT_SHADER, self->pend[1]);
+    if (!err) err = check_program(self->val);
+
+    /* The program keeps what it needs */
+    glDeleteShader(self->pend[0]);
+    glDeleteShader(self->pend[1]);
+
+    if (err) {
+        /* Remember the error, so every use of the shader raises it */
+        glDeleteProgram(self->val);
+        self->val = -1;
+        self->err = err;
+        KS_THROW(kst_Error, "%S", err);
+        return false;
+    }
+
+    if (!my_reflect(self)) {
+        return false;
+    }
+    if (self->cache) my_binstore(self->val, self->key);
+
+    return true;
+}
+
+int ksgl_shader_uniformloc(ksgl_shader self, ks_str name) {
+    if (!ksgl_shader_finish(self)) {
         return -1;
     }
 
-    return prog;
+    int idx = my_ufind(self, name);
+    if (idx < 0) {
+        /* Look it up once, and remember it (even if it doesn't exist) */
+        idx = self->nuniforms;
+        KS_INCREF(name);
+        my_uadd(self, name, glGetUniformLocation(self->val, name->data), 0, 0);
+    }
+
+    int pos = self->uniforms[idx].pos;
+    if (pos < 0) {
+        KS_THROW(kst_Error, "Unknown uniform %R", name);
+        return -1;
+    }
+
+    return pos;
+}
+
+bool ksgl_uniform_get(kso val, ksgl_uniform* out) {
+    if (kso_is_int(val)) {
+        /* Set as integer */
+        ks_cint v;
+        if (!kso_get_ci(val, &v)) {
+            return false;
+        }
+
+        out->isint = true;
+        out->m = out->n = 1;
+        out->i = v;
+        return true;
+    }
+
+    /* Some sort of matrix/vector */
+    nx_t vn;
+    kso ref = NULL;
+    if (!nx_get(val, nxd_F, &vn, &ref)) {
+        return false;
+    }
+
+    out->isint = false;
+    if (vn.rank == 0) {
+        /* Scalar */
+        out->m = out->n = 1;
+        out->f[0] = *(nx_F*)vn.data;
+    } else if (vn.rank == 1 || vn.rank == 2) {
+        /* Vector, or matrix */
+        int m = vn.rank == 1 ? 1 : vn.shape[0], n = vn.shape[vn.rank - 1];
+        ks_ssize_t sm = vn.rank == 1 ? 0 : vn.strides[0], sn = vn.strides[vn.rank - 1];
+        if (m < 1 || m > 4 || n < 1 || n > 4) {
+            if (vn.rank == 1) {
+                KS_THROW(kst_SizeError, "Expected rank-1 array to have length 1, 2, 3, or 4 for shader uniform");
+            } else {
+                KS_THROW(kst_SizeError, "Expected rank-2 array to have length 1, 2, 3, or 4 for both shapes");
+            }
+            KS_NDECREF(ref);
+            return false;
+        }
+
+        /* Copy into 'f', as dense array */
+        int i, j;
+        for (i = 0; i < m; ++i) {
+            for (j = 0; j < n; ++j) {
+                out->f[i * n + j] = *(nx_F*)((ks_uint)vn.data + sm * i + sn * j);
+            }
+        }
+        out->m = m;
+        out->n = n;
+    } else {
+        KS_THROW(kst_SizeError, "Only expected rank-0, rank-1, or rank-2 arrays for shader uniform");
+        KS_NDECREF(ref);
+        return false;
+    }
+
+    KS_NDECREF(ref);
+    return true;
 }
 
+void ksgl_uniform_set(int pos, ksgl_uniform* u) {
+    if (u->isint) {
+        glUniform1i(pos, u->i);
+    } else {
+        my_setf(pos, u->m, u->n, u->f);
+    }
+}
+
+bool ksgl_uniform_setobj(int pos, kso val) {
+    if (kso_issub(val->type, nxt_array) || kso_issub(val->type, nxt_view)) {
+        /* Dense 'nx.float' vectors and matrices are passed straight to OpenGL */
+        nx_t vn;
+        if (!ksgl_getnx(val, &vn)) {
+            return false;
+        }
+
+        int m = vn.rank == 2 ? vn.shape[0] : 1, n = vn.rank >= 1 ? vn.shape[vn.rank - 1] : 1;
+        if (vn.dtype == nxd_F && vn.rank <= 2 && m >= 1 && m <= 4 && n >= 1 && n <= 4 && ksgl_isdense(vn)) {
+            my_setf(pos, m, n, vn.data);
+            return true;
+        }
+    }
+
+    ksgl_uniform u;
+    if (!ksgl_uniform_get(val, &u)) {
+        return false;
+    }
+
+    ksgl_uniform_set(pos, &u);
+    return true;
+}
+
+/* Type Functions */
+
+static KS_TFUNC(T, free) {
+    ksgl_shader self;
+    KS_ARGS("self:*", &self, ksglt_shader);
+
+    if (self->pending) {
+        glDeleteShader(self->pend[0]);
+        glDeleteShader(self->pend[1]);
+    }
+    KS_NDECREF(self->err);
+
+    if (self->val >= 0) {
+        /* The name may be reused once it is no longer current */
+        if (ksgl_ctx.program == self->val) ksgl_ctx.program = KSGL_UNKNOWN;
+        glDeleteProgram(self->val);
+    }
+
+    int i;
+    for (i = 0; i < self->nuniforms; ++i) {
+        KS_DECREF(self->uniforms[i].name);
+    }
+    ks_free(self->uniforms);
+    ks_free(self->utab);
+
+    KSO_DEL(self);
+    return KSO_NONE;
+}
+
+
+
 static KS_TFUNC(T, init) {
     ksgl_shader self;
     ks_str src_vert, src_frag;
     KS_ARGS("self:* src_vert:* src_frag:*", &self, ksglt_shader, &src_vert, kst_str, &src_frag, kst_str);
 
-    self->val = -1;
-    
-    /* Compile vertex shader */
-    int sh_vert = compile_shader(GL_VERTEX_SHADER, src_vert);
-    if (sh_vert < 0) {
+    if (!my_submit(self, src_vert, src_frag) || !ksgl_shader_finish(self)) {
         return NULL;
     }
 
-    /* Compile fragment shader */
-    int sh_frag = compile_shader(GL_FRAGMENT_SHADER, src_frag);
-    if (sh_frag < 0) {
-        glDeleteShader(sh_vert);
-        return NULL;
-    }
+    return KSO_NONE;
+}
 
-    self->val = make_program(2, (int[]) { sh_vert, sh_frag });
-    glDeleteShader(sh_vert);
-    glDeleteShader(sh_frag);
-    if (self->val < 0) {
-        return NULL;
+static KS_TFUNC(T, getattr) {
+    ksgl_shader self;
+    ks_str attr;
+    KS_ARGS("self:* attr:*", &self, ksglt_shader, &attr, kst_str);
+
+    if (ks_str_eq_c(attr, "ready", 5)) {
+        /* Without 'KHR_parallel_shader_compile', there is no way to ask without waiting */
+        if (!self->pending || !my_parallel()) return KSO_TRUE;
+
+        GLint done = GL_FALSE;
+        glGetProgramiv(self->val, GL_COMPLETION_STATUS_KHR, &done);
+        return KSO_BOOL(done);
+    } else if (ks_str_eq_c(attr, "uniforms", 8)) {
+        if (!ksgl_shader_finish(self)) {
+            return NULL;
+        }
+
+        /* Uniforms which exist, as a dict of names to '(location, type, size)' */
+        ks_dict res = ks_dict_new(NULL);
+        int i;
+        for (i = 0; i < self->nuniforms; ++i) {
+            struct ksgl_uniforminfo* u = &self->uniforms[i];
+            if (u->pos < 0) continue;
+
+            ks_tuple v = ks_tuple_newn(3, (kso[]){
+                (kso)ks_int_new(u->pos),
+                (kso)ks_int_new(u->type),
+                (kso)ks_int_new(u->size),
+            });
+            ks_dict_set(res, (kso)u->name, (kso)v);
+            KS_DECREF(v);
+        }
+
+        return (kso)res;
     }
 
-    return KSO_NONE;
+    KS_THROW_ATTR(self, attr);
+    return NULL;
 }
 
 static KS_TFUNC(T, use) {
     ksgl_shader self;
     KS_ARGS("self:*", &self, ksglt_shader);
 
-    glUseProgram(self->val);
+    if (!ksgl_shader_finish(self)) {
+        return NULL;
+    }
+
+    ksgl_ctx_useprogram(self->val);
     if (!ksgl_check()) {
         return NULL;
     }
@@ -154,12 +724,8 @@ static KS_TFUNC(T, uniformloc) {
     ks_str name;
     KS_ARGS("self:* name:*", &self, ksglt_shader, &name, kst_str);
 
-    int pos = glGetUniformLocation(self->val, name->data);
+    int pos = ksgl_shader_uniformloc(self, name);
     if (pos < 0) {
-        KS_THROW(kst_Error, "Unknown uniform %R", name);
-        return NULL;
-    }
-    if (!ksgl_check()) {
         return NULL;
     }
 
@@ -168,139 +734,64 @@ static KS_TFUNC(T, uniformloc) {
 
 static KS_TFUNC(T, uniform) {
     ksgl_shader self;
-    ks_str name;
-    kso val;
-    KS_ARGS("self:* name:* val", &self, ksglt_shader, &name, kst_str, &val);
+    kso name, val;
+    KS_ARGS("self:* name val", &self, ksglt_shader, &name, &val);
 
-    int pos = glGetUniformLocation(self->val, name->data);
+    /* Either a location (i.e. from 'uniformloc()'), or a name */
+    int pos = my_getloc(self, name);
     if (pos < 0) {
-        KS_THROW(kst_Error, "Unknown uniform %R", name);
         return NULL;
     }
 
-    if (kso_is_int(val)) {
-        /* Set as integer */
-        ks_cint v;
-        if (!kso_get_ci(val, &v)) {
-            return NULL;
-        }
+    if (!ksgl_uniform_setobj(pos, val)) {
+        return NULL;
+    }
 
-        glUniform1i(pos, v);
+    return KSO_NONE;
+}
 
-    } else {
-        /* Some sort of matrix/vector */
+static KS_TFUNC(T, bind_block) {
+    ksgl_shader self;
+    ks_str name;
+    ks_cint point;
+    KS_ARGS("self:* name:* point:cint", &self, ksglt_shader, &name, kst_str, &point);
 
-        nx_t vn;
-        kso ref = NULL;
-        if (!nx_get(val, nxd_F, &vn, &ref)) {
-            return NULL;
-        }
+    if (!ksgl_shader_finish(self)) {
+        return NULL;
+    }
 
-        if (vn.rank == 0) {
-            /* Scalar */
-            glUniform1f(pos, *(nx_F*)vn.data);
-        } else if (vn.rank == 1) {
-            /* Vector */
-            int n = vn.shape[0];
-            int sn = vn.strides[0];
-            #define GET(_i) (*(nx_F*)((ks_uint)vn.data + sn * (_i)))
-
-            if (n == 1) {
-                glUniform1f(pos, GET(0));
-            } else if (n == 2) {
-                glUniform2f(pos, GET(0), GET(1));
-            } else if (n == 3) {
-                glUniform3f(pos, GET(0), GET(1), GET(2));
-            } else if (n == 4) {
-                glUniform4f(pos, GET(0), GET(1), GET(2), GET(3));
-            } else {
-                KS_THROW(kst_SizeError, "Expected rank-1 array to have length 1, 2, 3, or 4 for shader uniform");
-                KS_NDECREF(ref);
-                return NULL;
-            }
-            #undef GET
-        } else if (vn.rank == 2) {
-            /* Vector */
-            int m = vn.shape[0], n = vn.shape[1];
-            int sm = vn.strides[0], sn = vn.strides[1];
-            GLfloat v[16];
-
-            #define GET(_i, _j) (*(nx_F*)((ks_uint)vn.data + sm * (_i) + sn * (_j)))
-
-            /* Copy into 'v', as dense array */
-            #define COPY() do { \
-                int i, j; \
-                for (i = 0; i < m; ++i) { \
-                    for (j = 0; j < n; ++j) { \
-                        v[i * n + j] = GET(i, j); \
-                    } \
-                } \
-            } while (0)
-
-            if (m == 1 && n == 1) {
-                glUniform1f(pos, GET(0, 0));
-            } else if (m == 1 && n == 2) {
-                glUniform2f(pos, GET(0, 0), GET(0, 1));
-            } else if (m == 1 && n == 3) {
-                glUniform3f(pos, GET(0, 0), GET(0, 1), GET(0, 2));
-            } else if (m == 1 && n == 4) {
-                glUniform4f(pos, GET(0, 0), GET(0, 1), GET(0, 2), GET(0, 3));
-            } else if (m == 1 && n == 1) {
-                glUniform1f(pos, GET(0, 0));
-            } else if (m == 2 && n == 1) {
-                glUniform2f(pos, GET(0, 0), GET(1, 0));
-            } else if (m == 3 && n == 1) {
-                glUniform3f(pos, GET(0, 0), GET(1, 0), GET(2, 0));
-            } else if (m == 4 && n == 1) {
-                glUniform4f(pos, GET(0, 0), GET(1, 0), GET(2, 0), GET(3, 0));
-
-            } else if (m == 2 && n == 2) {
-                COPY();
-                glUniformMatrix2fv(pos, 1, GL_TRUE, v);
-            } else if (m == 2 && n == 3) {
-                COPY();
-                glUniformMatrix2x3fv(pos, 1, GL_TRUE, v);
-            } else if (m == 2 && n == 4) {
-                COPY();
-                glUniformMatrix2x4fv(pos, 1, GL_TRUE, v);
-            
-            } else if (m == 3 && n == 2) {
-                COPY();
-                glUniformMatrix3x2fv(pos, 1, GL_TRUE, v);
-            } else if (m == 3 && n == 3) {
-                COPY();
-                glUniformMatrix3fv(pos, 1, GL_TRUE, v);
-            } else if (m == 3 && n == 4) {
-                COPY();
-                glUniformMatrix3x4fv(pos, 1, GL_TRUE, v);
-
-            } else if (m == 4 && n == 2) {
-                COPY();
-                glUniformMatrix4x2fv(pos, 1, GL_TRUE, v);
-            } else if (m == 4 && n == 3) {
-                COPY();
-                glUniformMatrix4x3fv(pos, 1, GL_TRUE, v);
-            } else if (m == 4 && n == 4) {
-                COPY();
-                glUniformMatrix4fv(pos, 1, GL_TRUE, v);
+    GLuint idx = glGetUniformBlockIndex(self->val, name->data);
+    if (idx == GL_INVALID_INDEX) {
+        KS_THROW(kst_Error, "Unknown uniform block %R", name);
+        return NULL;
+    }
 
-            } else {
-                KS_THROW(kst_SizeError, "Expected rank-2 array to have length 1, 2, 3, or 4 for both shapes");
-                KS_NDECREF(ref);
-                return NULL;
-            }
+    glUniformBlockBinding(self->val, idx, point);
+    if (!ksgl_check()) {
+        return NULL;
+    }
 
-            #undef GET
-        } else {
-            KS_THROW(kst_SizeError, "Only expected rank-0, rank-1, or rank-2 arrays for shader uniform");
-            KS_NDECREF(ref);
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, set_uniforms) {
+    ksgl_shader self;
+    ks_dict vals;
+    KS_ARGS("self:* vals:*", &self, ksglt_shader, &vals, kst_dict);
+
+    ks_size_t i;
+    for (i = 0; i < vals->len_ents; ++i) {
+        if (!vals->ents[i].key) continue;
+
+        int pos = my_getloc(self, vals->ents[i].key);
+        if (pos < 0) {
+            return NULL;
+        }
+        if (!ksgl_uniform_setobj(pos, vals->ents[i].val)) {
             return NULL;
         }
-
-        KS_NDECREF(ref);
     }
 
-
     return KSO_NONE;
 }
 
@@ -314,10 +805,13 @@ void _ksgl_shader() {
     ksglt_shader = ks_type_new(T_NAME, kst_object, sizeof(struct ksgl_shader_s), -1, "OpenGL shader", KS_IKV(
         {"__free",                 ksf_wrap(T_free_, T_NAME ".__free(self)", "")},
         {"__init",                 ksf_wrap(T_init_, T_NAME ".__init(self, src_vert, src_frag)", "")},
+        {"__getattr",              ksf_wrap(T_getattr_, T_NAME ".__getattr(self, attr)", "")},
 
         {"use",                    ksf_wrap(T_use_, T_NAME ".use(self)", "Set this shader to the current OpenGL shader")},
-        {"uniform",                ksf_wrap(T_uniform_, T_NAME ".uniform(self, name, val)", "Set the uniform 'name' to a given value")},
-        {"uniformloc",             ksf_wrap(T_uniformloc_, T_NAME ".uniformloc(self, name)", "Return the uniform location")},
+        {"uniform",                ksf_wrap(T_uniform_, T_NAME ".uniform(self, name, val)", "Set the uniform 'name' (or the location returned by 'uniformloc()') to a given value")},
+        {"bind_block",             ksf_wrap(T_bind_block_, T_NAME ".bind_block(self, name, point)", "Links the uniform block 'name' to uniform buffer binding point 'point' (see 'gl.UBO.bind()'), which only needs to be done once")},
+        {"set_uniforms",           ksf_wrap(T_set_uniforms_, T_NAME ".set_uniforms(self, vals)", "Set each uniform in 'vals' (a dict of names or locations to values) in a single call")},
+        {"uniformloc",             ksf_wrap(T_uniformloc_, T_NAME ".uniformloc(self, name)", "Return the uniform location, which can be given to 'uniform()' to skip looking up the name")},
 
     ));
 }
@@ -0,0 +1,483 @@
+/* shadertemplate.c - gl.ShaderTemplate type
+ *
+ * Flags are given to the sources as '#define's, which are inserted after the '#version' line. Only the flags
+ *   which a source mentions are defined in it, so permutations which only differ in flags that are never used
+ *   give the same sources, and share the same program
+ *
+ * @author: Cade Brown <cade@kscript.org>
+ */
+#include <ksgl.h>
+
+#define T_NAME M_NAME ".ShaderTemplate"
+
+
+/* Internals */
+
+/* Maximum depth of nested '#include's (which catches cycles) */
+#define KSGL_INCLUDE_MAX 32
+
+/* Growable string */
+struct my_strbuf {
+    char* data;
+    ks_size_t len, cap;
+};
+
+/* Append 'n' bytes of 's' to 'sb' */
+static void my_sbadd(struct my_strbuf* sb, const char* s, ks_size_t n) {
+    if (sb->len + n > sb->cap) {
+        sb->cap = (sb->len + n) * 2 + 64;
+        sb->data = ks_zrealloc(sb->data, 1, sb->cap);
+    }
+    memcpy(sb->data + sb->len, s, n);
+    sb->len += n;
+}
+
+/* Convert 'sb' into a string, and free it */
+static ks_str my_sbdone(struct my_strbuf* sb) {
+    ks_str res = ks_str_new(sb->len, sb->data ? sb->data : "");
+    ks_free(sb->data);
+    return res;
+}
+
+/* Returns whether 'a' and 'b' have the same contents */
+static bool my_streq(ks_str a, ks_str b) {
+    return a->len_b == b->len_b && memcmp(a->data, b->data, a->len_b) == 0;
+}
+
+/* Compare strings (for sorting flags) */
+static int my_cmp_str(const void* A, const void* B) {
+    ks_str a = *(ks_str*)A, b = *(ks_str*)B;
+    int c = memcmp(a->data, b->data, a->len_b < b->len_b ? a->len_b : b->len_b);
+    return c != 0 ? c : (a->len_b < b->len_b ? -1 : (a->len_b > b->len_b ? 1 : 0));
+}
+
+/* Get the source of '#include'd file 'name' from 'includes' (a dict of names to sources, or a directory) */
+static ks_str my_getinclude(kso includes, ks_str name) {
+    if (kso_issub(includes->type, kst_dict)) {
+        if (!ks_dict_has((ks_dict)includes, (kso)name)) {
+            KS_THROW(kst_Error, "Unknown include %R", name);
+            return NULL;
+        }
+
+        kso res = ks_dict_get((ks_dict)includes, (kso)name);
+        if (!res) {
+            return NULL;
+        }
+        if (!kso_issub(res->type, kst_str)) {
+            KS_THROW(kst_TypeError, "Expected include %R to be a 'str', but got '%T'", name, res);
+            KS_DECREF(res);
+            return NULL;
+        }
+
+        return (ks_str)res;
+    } else if (kso_issub(includes->type, kst_str)) {
+        /* Read from the directory */
+        ks_str path = ks_fmt("%S/%S", includes, name);
+        FILE* fp = fopen(path->data, "rb");
+        KS_DECREF(path);
+        if (!fp) {
+            KS_THROW(kst_Error, "Failed to open include %R in %R", name, includes);
+            return NULL;
+        }
+
+        struct my_strbuf sb = { NULL, 0, 0 };
+        char buf[4096];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+            my_sbadd(&sb, buf, n);
+        }
+        fclose(fp);
+
+        return my_sbdone(&sb);
+    }
+
+    KS_THROW(kst_Error, "Unknown include %R (no includes were given)", name);
+    return NULL;
+}
+
+/* Append 'src' to 'out', replacing '#include "name"' (or '#include <name>') lines with the contents of the file
+ *
+ * Each file is included at most once (as if every file had an include guard), and 'seen' holds the names of
+ *   those which have been included
+ */
+static bool my_expand(struct my_strbuf* out, ks_str src, kso includes, ks_list seen, int depth) {
+    if (depth > KSGL_INCLUDE_MAX) {
+        KS_THROW(kst_Error, "'#include's are nested too deeply (max: %i)", KSGL_INCLUDE_MAX);
+        return false;
+    }
+
+    const char* p = src->data, *end = src->data + src->len_b;
+    while (p < end) {
+        const char* eol = memchr(p, '\n', end - p);
+        if (!eol) eol = end;
+
+        /* Check for '#include' */
+        const char* q = p;
+        while (q < eol && (*q == ' ' || *q == '\t')) q++;
+        if (q < eol && *q == '#') {
+            q++;
+            while (q < eol && (*q == ' ' || *q == '\t')) q++;
+            if (eol - q >= 7 && memcmp(q, "include", 7) == 0) {
+                q += 7;
+                while (q < eol && (*q == ' ' || *q == '\t')) q++;
+
+                char close = q < eol && *q == '<' ? '>' : '"';
+                const char* ne = q < eol && (*q == '<' || *q == '"') ? memchr(q + 1, close, eol - q - 1) : NULL;
+                if (!ne) {
+                    ks_str line = ks_str_new(eol - p, p);
+                    KS_THROW(kst_Error, "Invalid '#include': %R", line);
+                    KS_DECREF(line);
+                    return false;
+                }
+
+                ks_str name = ks_str_new(ne - q - 1, q + 1);
+                bool found = false;
+                int i;
+                for (i = 0; i < seen->len; ++i) {
+                    if (my_streq((ks_str)seen->elems[i], name)) {
+                        found = true;
+                        break;
+                    }
+                }
+
+                if (!found) {
+                    ks_list_push(seen, (kso)name);
+                    ks_str inc = my_getinclude(includes, name);
+                    if (!inc || !my_expand(out, inc, includes, seen, depth + 1)) {
+                        KS_NDECREF(inc);
+                        KS_DECREF(name);
+                        return false;
+                    }
+                    if (inc->len_b > 0 && inc->data[inc->len_b - 1] != '\n') my_sbadd(out, "\n", 1);
+                    KS_DECREF(inc);
+                }
+
+                KS_DECREF(name);
+                p = eol < end ? eol + 1 : end;
+                continue;
+            }
+        }
+
+        /* Copy the line as-is */
+        my_sbadd(out, p, (eol < end ? eol + 1 : end) - p);
+        p = eol < end ? eol + 1 : end;
+    }
+
+    return true;
+}
+
+/* Resolve the '#include's in 'src' */
+static ks_str my_resolve(ks_str src, kso includes) {
+    struct my_strbuf sb = { NULL, 0, 0 };
+    ks_list seen = ks_list_new(0, NULL);
+    bool ok = my_expand(&sb, src, includes, seen, 0);
+    KS_DECREF(seen);
+
+    ks_str res = my_sbdone(&sb);
+    if (!ok) {
+        KS_DECREF(res);
+        return NULL;
+    }
+
+    return res;
+}
+
+/* Get the name of a flag ('NAME' or 'NAME=VALUE'), setting '*n' to its length */
+static const char* my_flagname(ks_str flag, ks_size_t* n) {
+    const char* eq = memchr(flag->data, '=', flag->len_b);
+    *n = eq ? eq - flag->data : flag->len_b;
+    return flag->data;
+}
+
+/* Convert 'flags' (none, or an iterable of 'str') into a sorted list without duplicates, which is checked
+ *   against the flags of 'self'. Giving the same flag twice with different values is an error
+ */
+static ks_list my_getflags(ksgl_shadertemplate self, kso flags) {
+    if (flags == KSO_NONE) {
+        return ks_list_new(0, NULL);
+    }
+
+    ks_list res = ks_list_newi(flags);
+    if (!res) {
+        return NULL;
+    }
+
+    int i, j;
+    for (i = 0; i < res->len; ++i) {
+        if (!kso_issub(res->elems[i]->type, kst_str)) {
+            KS_THROW(kst_TypeError, "Expected flags to be 'str', but got '%T'", res->elems[i]);
+            KS_DECREF(res);
+            return NULL;
+        }
+
+        if (self->flags) {
+            ks_size_t n, fn;
+            const char* name = my_flagname((ks_str)res->elems[i], &n);
+            bool found = false;
+            for (j = 0; j < self->flags->len; ++j) {
+                const char* fname = my_flagname((ks_str)self->flags->elems[j], &fn);
+                if (n == fn && memcmp(name, fname, n) == 0) {
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) {
+                KS_THROW(kst_Error, "Unknown flag %R", res->elems[i]);
+                KS_DECREF(res);
+                return NULL;
+            }
+        }
+    }
+
+    qsort(res->elems, res->len, sizeof(*res->elems), my_cmp_str);
+
+    /* Remove duplicates */
+    j = 0;
+    for (i = 0; i < res->len; ++i) {
+        if (j > 0 && my_streq((ks_str)res->elems[j - 1], (ks_str)res->elems[i])) {
+            KS_DECREF(res->elems[i]);
+        } else {
+            res->elems[j++] = res->elems[i];
+        }
+    }
+    res->len = j;
+
+    /* Different values for the same flag would define it twice */
+    int k;
+    for (i = 0; i < res->len; ++i) {
+        ks_size_t n, kn;
+        const char* name = my_flagname((ks_str)res->elems[i], &n);
+        for (k = i + 1; k < res->len; ++k) {
+            const char* kname = my_flagname((ks_str)res->elems[k], &kn);
+            if (n == kn && memcmp(name, kname, n) == 0) {
+                KS_THROW(kst_Error, "Flag %R conflicts with %R", res->elems[i], res->elems[k]);
+                KS_DECREF(res);
+                return NULL;
+            }
+        }
+    }
+
+    return res;
+}
+
+/* Returns whether 'src' mentions 'n' bytes of 'name' */
+static bool my_mentions(ks_str src, const char* name, ks_size_t n) {
+    if (n == 0 || n > src->len_b) return false;
+
+    ks_size_t i;
+    for (i = 0; i + n <= src->len_b; ++i) {
+        if (src->data[i] == name[0] && memcmp(src->data + i, name, n) == 0) return true;
+    }
+
+    return false;
+}
+
+/* Define the flags in 'flags' which 'src' mentions, after its '#version' line (if it has one) */
+static ks_str my_define(ks_str src, ks_list flags) {
+    /* Skip the '#version' line, which must come first */
+    ks_size_t start = 0;
+    const char* q = src->data;
+    while (q < src->data + src->len_b && (*q == ' ' || *q == '\t' || *q == '\r' || *q == '\n')) q++;
+    if (src->data + src->len_b - q >= 8 && memcmp(q, "#version", 8) == 0) {
+        const char* eol = memchr(q, '\n', src->data + src->len_b - q);
+        start = eol ? eol - src->data + 1 : src->len_b;
+    }
+
+    struct my_strbuf sb = { NULL, 0, 0 };
+    my_sbadd(&sb, src->data, start);
+    if (start > 0 && src->data[start - 1] != '\n') my_sbadd(&sb, "\n", 1);
+
+    int i;
+    for (i = 0; i < flags->len; ++i) {
+        ks_str f = (ks_str)flags->elems[i];
+        ks_size_t n;
+        const char* name = my_flagname(f, &n);
+        if (!my_mentions(src, name, n)) continue;
+
+        my_sbadd(&sb, "#define ", 8);
+        my_sbadd(&sb, name, n);
+        if (n < f->len_b) {
+            /* 'NAME=VALUE' */
+            my_sbadd(&sb, " ", 1);
+            my_sbadd(&sb, f->data + n + 1, f->len_b - n - 1);
+        } else {
+            my_sbadd(&sb, " 1", 2);
+        }
+        my_sbadd(&sb, "\n", 1);
+    }
+
+    my_sbadd(&sb, src->data + start, src->len_b - start);
+    return my_sbdone(&sb);
+}
+
+/* Get the shader for 'flags', submitting it if it hasn't been requested yet. If 'finish', it is also
+ *   waited on (so any errors are thrown)
+ */
+static ksgl_shader my_get(ksgl_shadertemplate self, kso flags, bool finish) {
+    ks_list fl = my_getflags(self, flags);
+    if (!fl) {
+        return NULL;
+    }
+
+    /* Key of the variant, which is the sorted flags */
+    struct my_strbuf sb = { NULL, 0, 0 };
+    int i;
+    for (i = 0; i < fl->len; ++i) {
+        if (i > 0) my_sbadd(&sb, "\n", 1);
+        my_sbadd(&sb, ((ks_str)fl->elems[i])->data, ((ks_str)fl->elems[i])->len_b);
+    }
+    ks_str key = my_sbdone(&sb);
+
+    ksgl_shader res = NULL;
+    if (ks_dict_has(self->variants, (kso)key)) {
+        res = (ksgl_shader)ks_dict_get(self->variants, (kso)key);
+    } else {
+        ks_str vert = my_define(self->src_vert, fl), frag = my_define(self->src_frag, fl);
+        ks_tuple pkey = ks_tuple_newn(2, (kso[]){ (kso)vert, (kso)frag });
+
+        if (ks_dict_has(self->programs, (kso)pkey)) {
+            res = (ksgl_shader)ks_dict_get(self->programs, (kso)pkey);
+        } else {
+            res = ksgl_shader_submit(vert, frag);
+            if (res) ks_dict_set(self->programs, (kso)pkey, (kso)res);
+        }
+        KS_DECREF(pkey);
+
+        if (res) ks_dict_set(self->variants, (kso)key, (kso)res);
+    }
+
+    KS_DECREF(key);
+    KS_DECREF(fl);
+    if (!res) {
+        return NULL;
+    }
+
+    if (finish && !ksgl_shader_finish(res)) {
+        KS_DECREF(res);
+        return NULL;
+    }
+
+    return res;
+}
+
+
+/* C-API */
+
+/* Type Functions */
+
+static KS_TFUNC(T, free) {
+    ksgl_shadertemplate self;
+    KS_ARGS("self:*", &self, ksglt_shadertemplate);
+
+    KS_NDECREF(self->src_vert);
+    KS_NDECREF(self->src_frag);
+    KS_NDECREF(self->flags);
+    KS_NDECREF(self->variants);
+    KS_NDECREF(self->programs);
+
+    KSO_DEL(self);
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, init) {
+    ksgl_shadertemplate self;
+    ks_str src_vert, src_frag;
+    kso includes = KSO_NONE, flags = KSO_NONE;
+    KS_ARGS("self:* src_vert:* src_frag:* ?includes ?flags", &self, ksglt_shadertemplate, &src_vert, kst_str, &src_frag, kst_str, &includes, &flags);
+
+    self->src_vert = self->src_frag = NULL;
+    self->flags = NULL;
+    self->variants = ks_dict_new(NULL);
+    self->programs = ks_dict_new(NULL);
+
+    if (!(self->src_vert = my_resolve(src_vert, includes)) || !(self->src_frag = my_resolve(src_frag, includes))) {
+        return NULL;
+    }
+
+    if (flags != KSO_NONE) {
+        self->flags = ks_list_newi(flags);
+        if (!self->flags) {
+            return NULL;
+        }
+
+        int i;
+        for (i = 0; i < self->flags->len; ++i) {
+            if (!kso_issub(self->flags->elems[i]->type, kst_str)) {
+                KS_THROW(kst_TypeError, "Expected flags to be 'str', but got '%T'", self->flags->elems[i]);
+                return NULL;
+            }
+        }
+    }
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, getattr) {
+    ksgl_shadertemplate self;
+    ks_str attr;
+    KS_ARGS("self:* attr:*", &self, ksglt_shadertemplate, &attr, kst_str);
+
+    if (ks_str_eq_c(attr, "src_vert", 8)) {
+        return KS_NEWREF(self->src_vert);
+    } else if (ks_str_eq_c(attr, "src_frag", 8)) {
+        return KS_NEWREF(self->src_frag);
+    } else if (ks_str_eq_c(attr, "flags", 5)) {
+        return self->flags ? KS_NEWREF(self->flags) : KSO_NONE;
+    } else if (ks_str_eq_c(attr, "variants", 8)) {
+        return KS_NEWREF(self->variants);
+    } else if (ks_str_eq_c(attr, "nprograms", 9)) {
+        return (kso)ks_int_new(self->programs->len_ents);
+    }
+
+    KS_THROW_ATTR(self, attr);
+    return NULL;
+}
+
+static KS_TFUNC(T, get) {
+    ksgl_shadertemplate self;
+    kso flags = KSO_NONE;
+    KS_ARGS("self:* ?flags", &self, ksglt_shadertemplate, &flags);
+
+    return (kso)my_get(self, flags, true);
+}
+
+static KS_TFUNC(T, prepare) {
+    ksgl_shadertemplate self;
+    kso flagsets;
+    KS_ARGS("self:* flagsets", &self, ksglt_shadertemplate, &flagsets);
+
+    ks_list lv = ks_list_newi(flagsets);
+    if (!lv) {
+        return NULL;
+    }
+
+    /* Submitted together, and checked when they are first used */
+    int i;
+    for (i = 0; i < lv->len; ++i) {
+        ksgl_shader sh = my_get(self, lv->elems[i], false);
+        if (!sh) {
+            KS_DECREF(lv);
+            return NULL;
+        }
+        KS_DECREF(sh);
+    }
+
+    KS_DECREF(lv);
+    return KSO_NONE;
+}
+
+
+/* Export */
+
+ks_type ksglt_shadertemplate;
+
+void _ksgl_shadertemplate() {
+    ksglt_shadertemplate = ks_type_new(T_NAME, kst_object, sizeof(struct ksgl_shadertemplate_s), -1, "Shader sources with feature flags, whose permutations are compiled only when they are requested", KS_IKV(
+        {"__free",                 ksf_wrap(T_free_, T_NAME ".__free(self)", "")},
+        {"__init",                 ksf_wrap(T_init_, T_NAME ".__init(self, src_vert, src_frag, includes=none, flags=none)", "Creates a template from sources, whose '#include \"name\"' lines are replaced by the source 'name' from 'includes' (a dict of names to sources, or a directory to read them from). Each file is included at most once. If 'flags' is given, only those flags may be requested")},
+        {"__getattr",              ksf_wrap(T_getattr_, T_NAME ".__getattr(self, attr)", "")},
+
+        {"get",                    ksf_wrap(T_get_, T_NAME ".get(self, flags=none)", "Returns the shader with 'flags' (a list of 'NAME' or 'NAME=VALUE' strings, where each name may only be given once) defined, compiling it the first time it is requested. Flag sets which give the same sources share the same shader")},
+        {"prepare",                ksf_wrap(T_prepare_, T_NAME ".prepare(self, flagsets)", "Starts compiling the shaders for each set of flags in 'flagsets', without waiting for them (as 'gl.compile_shaders()' does)")},
+    ));
+}
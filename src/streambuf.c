@@ -0,0 +1,247 @@
+/* streambuf.c - gl.StreamBuffer type
+ *
+ * @author: Cade Brown <cade@kscript.org>
+ */
+#include <ksgl.h>
+
+#define T_NAME M_NAME ".StreamBuffer"
+
+
+/* Internals */
+
+/* Unmap the current region, if it is mapped */
+static bool my_unmap(ksgl_streambuf self) {
+    if (!self->ismapped) {
+        return true;
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, self->val);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    self->ismapped = false;
+
+    return ksgl_check();
+}
+
+
+/* C-API */
+
+/* Type Functions */
+
+static KS_TFUNC(T, free) {
+    ksgl_streambuf self;
+    KS_ARGS("self:*", &self, ksglt_streambuf);
+
+    if (self->fences) {
+        int i;
+        for (i = 0; i < self->nframes; ++i) {
+            if (self->fences[i]) glDeleteSync(self->fences[i]);
+        }
+        ks_free(self->fences);
+    }
+
+    if (self->val >= 0) {
+        if (self->pmap || self->ismapped) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, self->val);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        }
+        glDeleteBuffers(1, (GLuint[]){ self->val });
+    }
+
+    KSO_DEL(self);
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, init) {
+    ksgl_streambuf self;
+    ks_cint size, nframes = 3, target = GL_ARRAY_BUFFER;
+    KS_ARGS("self:* size:cint ?nframes:cint ?target:cint", &self, ksglt_streambuf, &size, &nframes, &target);
+
+    self->val = -1;
+    self->fences = NULL;
+    self->pmap = NULL;
+    self->ismapped = false;
+    self->cur = -1;
+
+    if (size <= 0) {
+        KS_THROW(kst_SizeError, "'size' must be positive, but got %i", (int)size);
+        return NULL;
+    }
+    if (nframes <= 0) {
+        KS_THROW(kst_SizeError, "'nframes' must be positive, but got %i", (int)nframes);
+        return NULL;
+    }
+
+    self->size = size;
+    self->nframes = nframes;
+    self->target = target;
+
+    self->fences = ks_zmalloc(sizeof(*self->fences), nframes);
+    int i;
+    for (i = 0; i < nframes; ++i) {
+        self->fences[i] = NULL;
+    }
+
+    /* Create buffer object */
+    GLuint t;
+    glGenBuffers(1, &t);
+    self->val = t;
+    if (!ksgl_check()) {
+        return NULL;
+    }
+
+    /* Bind to the copy target, so that we don't modify any VAO state */
+    glBindBuffer(GL_COPY_WRITE_BUFFER, self->val);
+
+    ks_size_t total = self->size * self->nframes;
+    if (ksgl_hasver(4, 4) || ksgl_hasext("GL_ARB_buffer_storage")) {
+        /* Immutable storage, which is mapped once for the lifetime of the object */
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, total, NULL, flags);
+        if (!ksgl_check()) {
+            return NULL;
+        }
+
+        self->pmap = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, total, flags);
+        if (!ksgl_check()) {
+            return NULL;
+        }
+    } else {
+        /* Mutable storage, which is mapped each frame */
+        glBufferData(GL_COPY_WRITE_BUFFER, total, NULL, GL_STREAM_DRAW);
+        if (!ksgl_check()) {
+            return NULL;
+        }
+    }
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, getattr) {
+    ksgl_streambuf self;
+    ks_str attr;
+    KS_ARGS("self:* attr:*", &self, ksglt_streambuf, &attr, kst_str);
+
+    if (ks_str_eq_c(attr, "size", 4)) {
+        return (kso)ks_int_new(self->size);
+    } else if (ks_str_eq_c(attr, "nframes", 7)) {
+        return (kso)ks_int_new(self->nframes);
+    } else if (ks_str_eq_c(attr, "offset", 6)) {
+        return (kso)ks_int_new(self->cur < 0 ? 0 : self->cur * self->size);
+    } else if (ks_str_eq_c(attr, "persistent", 10)) {
+        return KSO_BOOL(self->pmap != NULL);
+    }
+
+    KS_THROW_ATTR(self, attr);
+    return NULL;
+}
+
+static KS_TFUNC(T, bind) {
+    ksgl_streambuf self;
+    KS_ARGS("self:*", &self, ksglt_streambuf);
+
+    ksgl_ctx_bindbuf(self->target, self->val);
+    if (!ksgl_check()) {
+        return NULL;
+    }
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, unbind) {
+    ksgl_streambuf self;
+    KS_ARGS("self:*", &self, ksglt_streambuf);
+
+    ksgl_ctx_bindbuf(self->target, 0);
+    if (!ksgl_check()) {
+        return NULL;
+    }
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, next) {
+    ksgl_streambuf self;
+    nx_dtype dtype = nxd_u8;
+    kso shape = KSO_NONE;
+    KS_ARGS("self:* ?dtype:* ?shape", &self, ksglt_streambuf, &dtype, nxt_dtype, &shape);
+
+    /* Figure out the shape of the result */
+    int rank;
+    ks_size_t dims[NX_MAXRANK];
+    if (shape == KSO_NONE) {
+        rank = 1;
+        dims[0] = self->size / dtype->size;
+    } else if (!ksgl_getshape(shape, &rank, dims)) {
+        return NULL;
+    }
+
+    ks_size_t sz = dtype->size;
+    int i;
+    for (i = 0; i < rank; ++i) {
+        sz *= dims[i];
+    }
+    if (sz > self->size) {
+        KS_THROW(kst_SizeError, "Requested %i bytes, but regions are only %i bytes", (int)sz, (int)self->size);
+        return NULL;
+    }
+
+    /* Finish writing the previous region, and fence it, since all commands using it have been issued */
+    if (!my_unmap(self)) {
+        return NULL;
+    }
+    if (self->cur >= 0) {
+        self->fences[self->cur] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    /* Advance, and wait until the GPU is done with that region (typically, this is immediate) */
+    self->cur = (self->cur + 1) % self->nframes;
+    if (!ksgl_fence_wait(&self->fences[self->cur])) {
+        return NULL;
+    }
+
+    void* ptr;
+    ks_size_t offset = self->cur * self->size;
+    if (self->pmap) {
+        ptr = (void*)((ks_uint)self->pmap + offset);
+    } else {
+        /* We just waited on the fence, so it is safe to map without synchronization */
+        glBindBuffer(GL_COPY_WRITE_BUFFER, self->val);
+        ptr = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, self->size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (!ksgl_check()) {
+            return NULL;
+        }
+        self->ismapped = true;
+    }
+
+    return (kso)nx_view_newo(nxt_view, nx_make(ptr, dtype, rank, dims, NULL), (kso)self);
+}
+
+static KS_TFUNC(T, commit) {
+    ksgl_streambuf self;
+    KS_ARGS("self:*", &self, ksglt_streambuf);
+
+    if (!my_unmap(self)) {
+        return NULL;
+    }
+
+    return (kso)ks_int_new(self->cur < 0 ? 0 : self->cur * self->size);
+}
+
+
+/* Export */
+
+ks_type ksglt_streambuf;
+
+void _ksgl_streambuf() {
+    ksglt_streambuf = ks_type_new(T_NAME, kst_object, sizeof(struct ksgl_streambuf_s), -1, "Ring of mapped buffer regions, used for streaming per-frame dynamic data without implicit synchronization", KS_IKV(
+        {"__free",                 ksf_wrap(T_free_, T_NAME ".__free(self)", "")},
+        {"__init",                 ksf_wrap(T_init_, T_NAME ".__init(self, size, nframes=3, target=gl.ARRAY_BUFFER)", "Creates a buffer with 'nframes' regions of 'size' bytes each")},
+        {"__getattr",              ksf_wrap(T_getattr_, T_NAME ".__getattr(self, attr)", "")},
+
+        {"bind",                   ksf_wrap(T_bind_, T_NAME ".bind(self)", "Bind this buffer to its target")},
+        {"unbind",                 ksf_wrap(T_unbind_, T_NAME ".unbind(self)", "Unbind this buffer from its target")},
+
+        {"next",                   ksf_wrap(T_next_, T_NAME ".next(self, dtype=nx.u8, shape=none)", "Advance to the next region, waiting for the GPU to finish with it, and return an array which writes directly into it. The array is only valid until the next call to 'commit()' or 'next()'")},
+        {"commit",                 ksf_wrap(T_commit_, T_NAME ".commit(self)", "Finish writing the current region (required before drawing with it), and returns its byte offset in the buffer")},
+    ));
+}
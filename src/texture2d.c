@@ -17,7 +17,8 @@ static KS_TFUNC(T, free) {
     ksgl_texture2d self;
     KS_ARGS("self:*", &self, ksglt_texture2d);
 
-    if (self->val >= 0) glDeleteTextures(1, (GLuint[]){ self->val });
+    /* Recycle the handle (and storage), if it has any */
+    if (self->val >= 0) ksgl_ctx_release(KSGL_OBJ_TEXTURE, self->val, self->width < 0 ? NULL : (ks_size_t[]){ self->width, self->height, self->internalformat });
 
     KSO_DEL(self);
     return KSO_NONE;
@@ -36,11 +37,20 @@ static KS_TFUNC(T, init) {
 
     if (internalformat < 0) internalformat = format;
 
+    self->val = -1;
+    self->width = self->height = -1;
+    self->internalformat = internalformat;
 
-    /* Create buffer object */
+    /* Reuse a recycled texture with the same storage, if one exists */
+    bool isrecycled = false;
     GLuint t;
-    glGenTextures(1, &t);
-    self->val = t;
+    if (data != KSO_NONE && width >= 0 && height >= 0 && ksgl_ctx_take(KSGL_OBJ_TEXTURE, (ks_size_t[]){ width, height, internalformat }, &t)) {
+        self->val = t;
+        isrecycled = true;
+    } else {
+        /* Create texture object */
+        self->val = ksgl_ctx_gen(KSGL_OBJ_TEXTURE);
+    }
 
     /* Convert the data to its bytes equivalent */
     ks_bytes data_bytes = kso_bytes(data);
@@ -49,7 +59,7 @@ static KS_TFUNC(T, init) {
     }
 
     /* Bind as the currently used texture */
-    glBindTexture(GL_TEXTURE_2D, self->val);
+    ksgl_ctx_bindtex(-1, self->val);
     if (!ksgl_check()) {
         return NULL;
     }
@@ -66,9 +76,16 @@ static KS_TFUNC(T, init) {
             KS_THROW(kst_Error, "'width' and 'height' must be given if 'data' is given");
             return NULL;
         }
-        /* Upload image data */
-        glTexImage2D(GL_TEXTURE_2D, 0, internalformat, width, height, 0, format, type, data_bytes->data);
+        /* Upload image data (without reallocating, if the storage was recycled) */
+        if (isrecycled) {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, type, data_bytes->data);
+        } else {
+            glTexImage2D(GL_TEXTURE_2D, 0, internalformat, width, height, 0, format, type, data_bytes->data);
+        }
         glGenerateMipmap(GL_TEXTURE_2D);
+
+        self->width = width;
+        self->height = height;
     }
 
     /* Done with the bytes */
@@ -101,7 +118,7 @@ static KS_TFUNC(T, write) {
     }
 
     /* Bind as the currently used texture */
-    glBindTexture(GL_TEXTURE_2D, self->val);
+    ksgl_ctx_bindtex(-1, self->val);
     if (!ksgl_check()) {
         return NULL;
     }
@@ -112,6 +129,10 @@ static KS_TFUNC(T, write) {
         return NULL;
     }
 
+    self->width = width;
+    self->height = height;
+    self->internalformat = internalformat;
+
     glGenerateMipmap(GL_TEXTURE_2D);
     if (!ksgl_check()) {
         return NULL;
@@ -133,9 +154,8 @@ static KS_TFUNC(T, bind) {
         return NULL;
     }
 
-    /* Bind to that texture */
-    glActiveTexture(GL_TEXTURE0 + idx);
-    glBindTexture(GL_TEXTURE_2D, self->val);
+    /* Bind to that texture (if it isn't already) */
+    ksgl_ctx_bindtex(idx, self->val);
 
     return KSO_NONE;
 }
@@ -144,7 +164,7 @@ static KS_TFUNC(T, unbind) {
     ksgl_texture2d self;
     KS_ARGS("self:*", &self, ksglt_texture2d);
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+    ksgl_ctx_bindtex(-1, 0);
 
     return KSO_NONE;
 }
@@ -0,0 +1,310 @@
+/* ubo.c - gl.UBO type
+ *
+ * Members are laid out with the std140 rules, so the offsets match any uniform block declared with
+ *   'layout(std140)' and the same members in the same order. Scalars take 4 bytes, 'vec2' takes 8 (aligned
+ *   to 8), 'vec3' and 'vec4' are aligned to 16, and matrices are stored as one 16 byte aligned 'vec4' per column
+ *
+ * @author: Cade Brown <cade@kscript.org>
+ */
+#include <ksgl.h>
+
+#define T_NAME M_NAME ".UBO"
+
+
+/* Internals */
+
+/* Round 'x' up to a multiple of 'a' */
+static ks_size_t my_align(ks_size_t x, ks_size_t a) {
+    return (x + a - 1) / a * a;
+}
+
+/* Get the alignment and size (in bytes) of a member shaped like 'u' */
+static void my_layout(ksgl_uniform* u, ks_size_t* align, ks_size_t* size) {
+    int k = u->m * u->n;
+    if (u->m == 1 || u->n == 1) {
+        /* Scalar or vector */
+        *align = k == 1 ? 4 : (k == 2 ? 8 : 16);
+        *size = 4 * k;
+    } else {
+        /* Matrix, with a column per column of the array (which is row-major) */
+        *align = 16;
+        *size = 16 * u->n;
+    }
+}
+
+/* Find the member 'name' (there are few members, so they are searched in order) */
+static struct ksgl_ubofield* my_find(ksgl_ubo self, ks_str name) {
+    int i;
+    for (i = 0; i < self->nfields; ++i) {
+        ks_str k = self->fields[i].name;
+        if (k->len_b == name->len_b && memcmp(k->data, name->data, k->len_b) == 0) {
+            return &self->fields[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* Pack 'val' into the member 'f', returning the number of bytes written */
+static ks_size_t my_pack(ksgl_ubo self, struct ksgl_ubofield* f, kso val) {
+    ksgl_uniform u;
+    if (!ksgl_uniform_get(val, &u)) {
+        return 0;
+    }
+
+    unsigned char* dst = self->data + f->offset;
+    if (f->isint) {
+        if (!u.isint) {
+            KS_THROW(kst_TypeError, "Member %R is an integer, but got '%T'", f->name, val);
+            return 0;
+        }
+        *(GLint*)dst = u.i;
+        return 4;
+    }
+
+    if (u.isint) {
+        /* Integers are allowed for floating point members */
+        u.isint = false;
+        u.m = u.n = 1;
+        u.f[0] = u.i;
+    }
+
+    bool isvec = f->m == 1 || f->n == 1;
+    if (isvec ? (u.m != 1 && u.n != 1) || u.m * u.n != f->m * f->n : u.m != f->m || u.n != f->n) {
+        KS_THROW(kst_SizeError, "Member %R has shape (%i, %i), but got (%i, %i)", f->name, f->m, f->n, u.m, u.n);
+        return 0;
+    }
+
+    GLfloat* fdst = (GLfloat*)dst;
+    if (isvec) {
+        memcpy(fdst, u.f, sizeof(*fdst) * u.m * u.n);
+        return sizeof(*fdst) * u.m * u.n;
+    }
+
+    /* Transpose into columns, each of which is padded to a 'vec4' */
+    int i, j;
+    for (j = 0; j < u.n; ++j) {
+        for (i = 0; i < u.m; ++i) {
+            fdst[4 * j + i] = u.f[i * u.n + j];
+        }
+    }
+
+    return 16 * u.n;
+}
+
+/* Pack each value in 'vals' (a dict of member names to values), and upload the range that changed */
+static bool my_update(ksgl_ubo self, ks_dict vals) {
+    ks_size_t lo = self->size, hi = 0;
+
+    ks_size_t i;
+    for (i = 0; i < vals->len_ents; ++i) {
+        kso k = vals->ents[i].key;
+        if (!k) continue;
+        if (!kso_issub(k->type, kst_str)) {
+            KS_THROW(kst_TypeError, "Expected member names to be 'str', but got '%T'", k);
+            return false;
+        }
+
+        struct ksgl_ubofield* f = my_find(self, (ks_str)k);
+        if (!f) {
+            KS_THROW(kst_Error, "Unknown member %R", k);
+            return false;
+        }
+
+        ks_size_t sz = my_pack(self, f, vals->ents[i].val);
+        if (sz == 0) {
+            return false;
+        }
+
+        if (f->offset < lo) lo = f->offset;
+        if (f->offset + sz > hi) hi = f->offset + sz;
+    }
+
+    if (hi <= lo) {
+        return true;
+    }
+
+    /* Upload everything which changed in a single call */
+    ksgl_ctx_bindbuf(GL_UNIFORM_BUFFER, self->val);
+    glBufferSubData(GL_UNIFORM_BUFFER, lo, hi - lo, self->data + lo);
+
+    ksgl_stats.n_upload++;
+    ksgl_stats.sz_upload += hi - lo;
+
+    return ksgl_check();
+}
+
+
+/* C-API */
+
+/* Type Functions */
+
+static KS_TFUNC(T, free) {
+    ksgl_ubo self;
+    KS_ARGS("self:*", &self, ksglt_ubo);
+
+    if (self->val >= 0) ksgl_ctx_release(KSGL_OBJ_BUFFER, self->val, self->pool ? (ks_size_t[]){ self->size, self->usage, 0 } : NULL);
+
+    int i;
+    for (i = 0; i < self->nfields; ++i) {
+        KS_DECREF(self->fields[i].name);
+    }
+    ks_free(self->fields);
+    ks_free(self->data);
+
+    KSO_DEL(self);
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, init) {
+    ksgl_ubo self;
+    ks_dict fields;
+    ks_cint usage = GL_DYNAMIC_DRAW;
+    KS_ARGS("self:* fields:* ?usage:cint", &self, ksglt_ubo, &fields, kst_dict, &usage);
+
+    self->val = -1;
+    self->size = 0;
+    self->usage = usage;
+    self->pool = true;
+    self->nfields = 0;
+    self->fields = NULL;
+    self->data = NULL;
+
+    /* Lay out the members in order, with types taken from their initial values */
+    ks_size_t i;
+    for (i = 0; i < fields->len_ents; ++i) {
+        kso k = fields->ents[i].key;
+        if (!k) continue;
+        if (!kso_issub(k->type, kst_str)) {
+            KS_THROW(kst_TypeError, "Expected member names to be 'str', but got '%T'", k);
+            return NULL;
+        }
+
+        ksgl_uniform u;
+        if (!ksgl_uniform_get(fields->ents[i].val, &u)) {
+            return NULL;
+        }
+
+        ks_size_t align, size;
+        my_layout(&u, &align, &size);
+
+        self->fields = ks_zrealloc(self->fields, sizeof(*self->fields), self->nfields + 1);
+        struct ksgl_ubofield* f = &self->fields[self->nfields++];
+        KS_INCREF(k);
+        f->name = (ks_str)k;
+        f->offset = my_align(self->size, align);
+        f->isint = u.isint;
+        f->m = u.m;
+        f->n = u.n;
+
+        self->size = f->offset + size;
+    }
+
+    /* The size of a block is rounded up to a 'vec4' */
+    self->size = my_align(self->size > 0 ? self->size : 16, 16);
+    self->data = ks_zmalloc(1, self->size);
+    if (!self->data) {
+        KS_THROW(kst_Error, "Failed to allocate data");
+        return NULL;
+    }
+    memset(self->data, 0, self->size);
+
+    GLuint t;
+    if (ksgl_ctx_take(KSGL_OBJ_BUFFER, (ks_size_t[]){ self->size, self->usage, 0 }, &t)) {
+        self->val = t;
+    } else {
+        self->val = ksgl_ctx_gen(KSGL_OBJ_BUFFER);
+        ksgl_ctx_bindbuf(GL_UNIFORM_BUFFER, self->val);
+        glBufferData(GL_UNIFORM_BUFFER, self->size, NULL, usage);
+    }
+
+    if (!my_update(self, fields)) {
+        return NULL;
+    }
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, str) {
+    ksgl_ubo self;
+    KS_ARGS("self:*", &self, ksglt_ubo);
+
+    return (kso)ks_fmt("<%T nfields=%i, size=%i>", self, self->nfields, (int)self->size);
+}
+
+static KS_TFUNC(T, getattr) {
+    ksgl_ubo self;
+    ks_str attr;
+    KS_ARGS("self:* attr:*", &self, ksglt_ubo, &attr, kst_str);
+
+    if (ks_str_eq_c(attr, "size", 4)) {
+        return (kso)ks_int_new(self->size);
+    } else if (ks_str_eq_c(attr, "usage", 5)) {
+        return (kso)ks_int_new(self->usage);
+    } else if (ks_str_eq_c(attr, "offsets", 7)) {
+        /* Byte offset of each member */
+        ks_dict res = ks_dict_new(NULL);
+        int i;
+        for (i = 0; i < self->nfields; ++i) {
+            ks_int v = ks_int_new(self->fields[i].offset);
+            ks_dict_set(res, (kso)self->fields[i].name, (kso)v);
+            KS_DECREF(v);
+        }
+
+        return (kso)res;
+    }
+
+    KS_THROW_ATTR(self, attr);
+    return NULL;
+}
+
+static KS_TFUNC(T, update) {
+    ksgl_ubo self;
+    ks_dict vals;
+    KS_ARGS("self:* vals:*", &self, ksglt_ubo, &vals, kst_dict);
+
+    if (!my_update(self, vals)) {
+        return NULL;
+    }
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, bind) {
+    ksgl_ubo self;
+    ks_cint point, offset = 0, size = -1;
+    KS_ARGS("self:* point:cint ?offset:cint ?size:cint", &self, ksglt_ubo, &point, &offset, &size);
+
+    if (size < 0) size = self->size - offset;
+    if (offset < 0 || offset + size > self->size) {
+        KS_THROW(kst_SizeError, "Range of %i bytes starting at %i is out of range for %i bytes", (int)size, (int)offset, (int)self->size);
+        return NULL;
+    }
+
+    /* The binding point refers to this handle until something else is bound to it */
+    self->pool = false;
+    glBindBufferRange(GL_UNIFORM_BUFFER, point, self->val, offset, size);
+    if (!ksgl_check()) {
+        return NULL;
+    }
+
+    return KSO_NONE;
+}
+
+
+/* Export */
+
+ks_type ksglt_ubo;
+
+void _ksgl_ubo() {
+    ksglt_ubo = ks_type_new(T_NAME, kst_object, sizeof(struct ksgl_ubo_s), -1, "OpenGL uniform buffer object, whose members are packed with the std140 layout", KS_IKV(
+        {"__free",                 ksf_wrap(T_free_, T_NAME ".__free(self)", "")},
+        {"__init",                 ksf_wrap(T_init_, T_NAME ".__init(self, fields, usage=gl.DYNAMIC_DRAW)", "Creates a uniform buffer from 'fields', a dict of member names to initial values (integers, floats, vectors, or matrices), which determine the type of each member. They must be in the same order as the members of the 'layout(std140)' uniform block")},
+        {"__str",                  ksf_wrap(T_str_, T_NAME ".__str(self)", "")},
+        {"__repr",                 ksf_wrap(T_str_, T_NAME ".__repr(self)", "")},
+        {"__getattr",              ksf_wrap(T_getattr_, T_NAME ".__getattr(self, attr)", "")},
+
+        {"update",                 ksf_wrap(T_update_, T_NAME ".update(self, vals)", "Sets members from 'vals' (a dict of member names to values), uploading the range which changed in a single call")},
+        {"bind",                   ksf_wrap(T_bind_, T_NAME ".bind(self, point, offset=0, size=-1)", "Binds 'size' bytes (default: the rest) starting at 'offset' to uniform buffer binding point 'point', which shaders can be linked to with 'gl.Shader.bind_block()'")},
+    ));
+}
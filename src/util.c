@@ -5,6 +5,12 @@
 #include <ksgl.h>
 
 
+/* Global statistics */
+struct ksgl_stats_s ksgl_stats;
+
+
+/* C-API */
+
 bool ksgl_check() {
     int rc = glGetError();
     if (!rc) {
@@ -16,6 +22,154 @@ bool ksgl_check() {
 }
 
 
+bool ksgl_getshape(kso obj, int* rank, ks_size_t* shape) {
+    if (kso_is_int(obj)) {
+        ks_cint v;
+        if (!kso_get_ci(obj, &v)) {
+            return false;
+        }
+        if (v < 0) {
+            KS_THROW(kst_SizeError, "Shape must not be negative");
+            return false;
+        }
+
+        *rank = 1;
+        shape[0] = v;
+        return true;
+    }
+
+    ks_list lv = ks_list_newi(obj);
+    if (!lv) {
+        return false;
+    }
+    if (lv->len > NX_MAXRANK) {
+        KS_THROW(kst_SizeError, "Shape has too many dimensions (max: %i)", NX_MAXRANK);
+        KS_DECREF(lv);
+        return false;
+    }
+
+    int i;
+    for (i = 0; i < lv->len; ++i) {
+        ks_cint v;
+        if (!kso_get_ci(lv->elems[i], &v)) {
+            KS_DECREF(lv);
+            return false;
+        }
+        if (v < 0) {
+            KS_THROW(kst_SizeError, "Shape must not be negative");
+            KS_DECREF(lv);
+            return false;
+        }
+        shape[i] = v;
+    }
+
+    *rank = lv->len;
+    KS_DECREF(lv);
+    return true;
+}
+
+int ksgl_idxsize(int type) {
+    if (type == GL_UNSIGNED_INT) {
+        return 4;
+    } else if (type == GL_UNSIGNED_SHORT) {
+        return 2;
+    } else if (type == GL_UNSIGNED_BYTE) {
+        return 1;
+    }
+
+    return 0;
+}
+
+GLuint ksgl_idxrestart(int type) {
+    if (type == GL_UNSIGNED_SHORT) {
+        return 0xFFFF;
+    } else if (type == GL_UNSIGNED_BYTE) {
+        return 0xFF;
+    }
+
+    return 0xFFFFFFFF;
+}
+
+bool ksgl_hasver(int major, int minor) {
+    GLint ma = 0, mi = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &ma);
+    glGetIntegerv(GL_MINOR_VERSION, &mi);
+    glGetError();
+
+    return ma > major || (ma == major && mi >= minor);
+}
+
+bool ksgl_hasext(const char* name) {
+    GLint n = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+
+    int i;
+    for (i = 0; i < n; ++i) {
+        const char* ext = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (ext && strcmp(ext, name) == 0) {
+            return true;
+        }
+    }
+
+    glGetError();
+    return false;
+}
+
+bool ksgl_fence_wait(GLsync* fence) {
+    if (!*fence) {
+        return true;
+    }
+
+    /* First, poll without flushing, and then flush and wait (in 1ms increments) */
+    GLbitfield flags = 0;
+    GLuint64 timeout = 0;
+    while (true) {
+        GLenum rc = glClientWaitSync(*fence, flags, timeout);
+        if (rc == GL_ALREADY_SIGNALED || rc == GL_CONDITION_SATISFIED) {
+            break;
+        } else if (rc == GL_WAIT_FAILED) {
+            /* Report the failure even if no error is pending, since the GPU may still be using the data */
+            glDeleteSync(*fence);
+            *fence = NULL;
+            if (ksgl_check()) {
+                KS_THROW(kst_Error, "Failed to wait for fence");
+            }
+            return false;
+        }
+
+        if (!flags) ksgl_stats.n_sync_stall++;
+        flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        timeout = 1000000;
+    }
+
+    glDeleteSync(*fence);
+    *fence = NULL;
+    return true;
+}
+
+bool ksgl_getbuffer(kso obj, int* val, ks_size_t* offset, ks_size_t* size) {
+    if (kso_issub(obj->type, ksglt_vbo)) {
+        *val = ((ksgl_vbo)obj)->val;
+        *offset = 0;
+        *size = ((ksgl_vbo)obj)->size;
+        return true;
+    } else if (kso_issub(obj->type, ksglt_arena_alloc)) {
+        ksgl_arena_alloc alloc = (ksgl_arena_alloc)obj;
+        if (!alloc->arena) {
+            KS_THROW(kst_Error, "Allocation has already been freed");
+            return false;
+        }
+
+        *val = alloc->arena->val;
+        *offset = alloc->offset;
+        *size = alloc->size;
+        return true;
+    }
+
+    KS_THROW(kst_TypeError, "Expected a '%S' or '%S', but got '%T'", ksglt_vbo, ksglt_arena_alloc, obj);
+    return false;
+}
+
 bool ksgl_getcolor(int nargs, kso* args, ks_cfloat* out) {
     /* Default alpha to 1.0 */
     out[3] = 1.0;
@@ -37,5 +191,211 @@ bool ksgl_getcolor(int nargs, kso* args, ks_cfloat* out) {
     return true;
 }
 
+bool ksgl_getrect(kso obj, GLint* out) {
+    ks_list lv = ks_list_newi(obj);
+    if (!lv) {
+        return false;
+    }
+    if (lv->len != 4) {
+        KS_THROW(kst_SizeError, "Expected a rectangle '(x, y, w, h)', but got %R", obj);
+        KS_DECREF(lv);
+        return false;
+    }
 
+    int i;
+    for (i = 0; i < 4; ++i) {
+        ks_cint v;
+        if (!kso_get_ci(lv->elems[i], &v)) {
+            KS_DECREF(lv);
+            return false;
+        }
+        out[i] = v;
+    }
+
+    KS_DECREF(lv);
+    return true;
+}
+
+
+
+
+
+bool ksgl_buf_get(kso obj, ksgl_buf* out) {
+    out->data = NULL;
+    out->len = 0;
+    out->ref = NULL;
+    out->tmp = NULL;
+
+    if (obj == KSO_NONE) {
+        return true;
+    }
+
+    /* Number of bytes copied on the CPU */
+    ks_size_t copied = 0;
+
+    if (kso_issub(obj->type, kst_bytes)) {
+        /* Use bytes in place */
+        ks_bytes b = (ks_bytes)obj;
+        KS_INCREF(obj);
+        out->ref = obj;
+        out->data = b->data;
+        out->len = b->len_b;
+
+    } else if (kso_issub(obj->type, nxt_array) || kso_issub(obj->type, nxt_view)) {
+        nx_t val;
+        if (!ksgl_getnx(obj, &val)) {
+            return false;
+        }
+
+        ks_size_t len = ksgl_nbytes(val);
+        if (ksgl_isdense(val)) {
+            /* Use the array's storage directly */
+            KS_INCREF(obj);
+            out->ref = obj;
+            out->data = val.data;
+            out->len = len;
+        } else {
+            /* Gather into dense temporary storage, in a single pass */
+            out->tmp = ks_malloc(len);
+            if (!out->tmp && len > 0) {
+                KS_THROW(kst_Error, "Failed to allocate data");
+                return false;
+            }
+            if (!nx_cast(val, nx_make(out->tmp, val.dtype, val.rank, val.shape, NULL))) {
+                ks_free(out->tmp);
+                out->tmp = NULL;
+                return false;
+            }
+            out->data = out->tmp;
+            out->len = len;
+            copied = len;
+        }
+
+    } else {
+        /* Generic conversion */
+        ks_bytes b = kso_bytes(obj);
+        if (!b) {
+            return false;
+        }
+        out->ref = (kso)b;
+        out->data = b->data;
+        out->len = b->len_b;
+        copied = b->len_b;
+    }
+
+    ksgl_stats.n_upload++;
+    ksgl_stats.sz_upload += out->len;
+    ksgl_stats.sz_upload_copied += copied;
+
+    return true;
+}
+
+bool ksgl_buf_getas(kso obj, nx_dtype dtype, ksgl_buf* out) {
+    out->data = NULL;
+    out->len = 0;
+    out->ref = NULL;
+    out->tmp = NULL;
+
+    nx_t val;
+    kso ref = NULL;
+    if (!nx_get(obj, dtype, &val, &ref)) {
+        return false;
+    }
+    if (!ref) {
+        KS_INCREF(obj);
+        ref = obj;
+    }
+    out->ref = ref;
+    out->len = ksgl_nbytes(val) / val.dtype->size * dtype->size;
+
+    if (val.dtype == dtype && ksgl_isdense(val)) {
+        /* Use the array's storage directly */
+        out->data = val.data;
+    } else {
+        /* Convert into dense temporary storage, in a single pass */
+        out->tmp = ks_malloc(out->len);
+        if (!out->tmp && out->len > 0) {
+            KS_THROW(kst_Error, "Failed to allocate data");
+            ksgl_buf_done(out);
+            return false;
+        }
+        if (!nx_cast(val, nx_make(out->tmp, dtype, val.rank, val.shape, NULL))) {
+            ksgl_buf_done(out);
+            return false;
+        }
+        out->data = out->tmp;
+    }
+
+    return true;
+}
+
+void ksgl_buf_done(ksgl_buf* buf) {
+    KS_NDECREF(buf->ref);
+    if (buf->tmp) ks_free(buf->tmp);
+    buf->ref = NULL;
+    buf->tmp = NULL;
+    buf->data = NULL;
+    buf->len = 0;
+}
+
+bool ksgl_getnx(kso obj, nx_t* out) {
+    if (kso_issub(obj->type, nxt_array)) {
+        *out = ((nx_array)obj)->val;
+        return true;
+    } else if (kso_issub(obj->type, nxt_view)) {
+        *out = ((nx_view)obj)->val;
+        return true;
+    }
+
+    KS_THROW(kst_TypeError, "Expected 'nx.array' or 'nx.view', but got '%T'", obj);
+    return false;
+}
+
+bool ksgl_read_into(int target, ks_size_t offset, nx_t out) {
+    ks_size_t len = ksgl_nbytes(out);
+    if (ksgl_isdense(out)) {
+        /* Read directly into the array */
+        glGetBufferSubData(target, offset, len, out.data);
+        return ksgl_check();
+    }
+
+    /* Read into temporary storage, then scatter into the array */
+    void* tmp = ks_malloc(len);
+    if (!tmp && len > 0) {
+        KS_THROW(kst_Error, "Failed to allocate data");
+        return false;
+    }
+
+    glGetBufferSubData(target, offset, len, tmp);
+    if (!ksgl_check()) {
+        ks_free(tmp);
+        return false;
+    }
+
+    bool res = nx_cast(nx_make(tmp, out.dtype, out.rank, out.shape, NULL), out);
+    ks_free(tmp);
+    return res;
+}
+
+bool ksgl_isdense(nx_t val) {
+    ks_ssize_t sz = val.dtype->size;
+    int i;
+    for (i = val.rank - 1; i >= 0; --i) {
+        if (val.shape[i] != 1 && val.strides[i] != sz) {
+            return false;
+        }
+        sz *= val.shape[i];
+    }
+
+    return true;
+}
 
+ks_size_t ksgl_nbytes(nx_t val) {
+    ks_size_t res = val.dtype->size;
+    int i;
+    for (i = 0; i < val.rank; ++i) {
+        res *= val.shape[i];
+    }
+
+    return res;
+}
@@ -7,6 +7,167 @@
 
 /** Internal utilities type **/
 
+/* Directed edge of a triangle, in the edge table used for stripification */
+struct my_edge {
+
+    /* Start and end vertex */
+    nx_u32 a, b;
+
+    /* Triangle it belongs to (or -1 if the slot is empty) */
+    ks_ssize_t tri;
+
+};
+
+/* Hash a directed edge */
+static ks_size_t my_ehash(nx_u32 a, nx_u32 b) {
+    ks_uint h = (ks_uint)a * 0x9E3779B97F4A7C15ULL ^ ((ks_uint)b + 0x632BE59BD9B4E019ULL) * 0xC2B2AE3D27D4EB4FULL;
+    return h ^ (h >> 29);
+}
+
+/* Find a triangle which has not been used (according to 'used' and 'stamp') with the directed
+ *   edge 'a' -> 'b', returning its index (or -1) and setting '*c' to its third vertex
+ */
+static ks_ssize_t my_efind(struct my_edge* edges, ks_size_t mask, const nx_u32* idx, int* used, int stamp, nx_u32 a, nx_u32 b, nx_u32* c) {
+    ks_size_t i = my_ehash(a, b) & mask;
+    while (edges[i].tri >= 0) {
+        ks_ssize_t t = edges[i].tri;
+        if (edges[i].a == a && edges[i].b == b && used[t] != -1 && used[t] != stamp) {
+            const nx_u32* v = &idx[3 * t];
+            *c = (v[0] != a && v[0] != b) ? v[0] : ((v[1] != a && v[1] != b) ? v[1] : v[2]);
+            return t;
+        }
+        i = (i + 1) & mask;
+    }
+
+    return -1;
+}
+
+/* Grow a strip whose last two vertices are 'p' and 'q', and whose next triangle is the 'k'th, marking
+ *   triangles with 'stamp' and appending vertices to 'out' (if non-NULL). Returns the number of vertices added
+ */
+static ks_size_t my_grow(struct my_edge* edges, ks_size_t mask, const nx_u32* idx, int* used, int stamp, nx_u32 p, nx_u32 q, ks_size_t k, nx_u32* out) {
+    ks_size_t n = 0;
+    while (true) {
+        /* Odd triangles in a strip have reversed winding */
+        nx_u32 x;
+        ks_ssize_t t = (k % 2 == 0) ? my_efind(edges, mask, idx, used, stamp, p, q, &x) : my_efind(edges, mask, idx, used, stamp, q, p, &x);
+        if (t < 0) break;
+
+        used[t] = stamp;
+        if (out) out[n] = x;
+        n++;
+        k++;
+        p = q;
+        q = x;
+    }
+
+    return n;
+}
+
+
+/* C-API */
+
+nx_u32* ksgl_stripify(const nx_u32* idx, ks_size_t ntri, nx_u32 restart, ks_size_t* nout) {
+    /* At worst, every triangle is its own strip */
+    nx_u32* res = ks_malloc(sizeof(*res) * (4 * ntri + 1));
+    int* used = ks_zmalloc(sizeof(*used), ntri + 1);
+
+    /* Table of directed edges, at most half full */
+    ks_size_t cap = 16;
+    while (cap < 6 * ntri) cap *= 2;
+    ks_size_t mask = cap - 1;
+    struct my_edge* edges = ks_zmalloc(sizeof(*edges), cap);
+    if (!res || !used || !edges) {
+        ks_free(res);
+        ks_free(used);
+        ks_free(edges);
+        KS_THROW(kst_Error, "Failed to allocate data");
+        return NULL;
+    }
+
+    ks_size_t i;
+    int j;
+    for (i = 0; i < cap; ++i) {
+        edges[i].tri = -1;
+    }
+    for (i = 0; i < ntri; ++i) {
+        used[i] = 0;
+        for (j = 0; j < 3; ++j) {
+            nx_u32 a = idx[3 * i + j], b = idx[3 * i + (j + 1) % 3];
+            ks_size_t h = my_ehash(a, b) & mask;
+            while (edges[h].tri >= 0) h = (h + 1) & mask;
+            edges[h].a = a;
+            edges[h].b = b;
+            edges[h].tri = i;
+        }
+    }
+
+    ks_size_t n = 0;
+    int stamp = 0;
+    for (i = 0; i < ntri; ++i) {
+        if (used[i] == -1) continue;
+        const nx_u32* v = &idx[3 * i];
+
+        /* Try starting with each rotation of the triangle, and keep the longest */
+        int r, best = 0;
+        ks_size_t bestn = 0;
+        for (r = 0; r < 3; ++r) {
+            used[i] = ++stamp;
+            ks_size_t sn = my_grow(edges, mask, idx, used, stamp, v[(r + 1) % 3], v[(r + 2) % 3], 1, NULL);
+            if (r == 0 || sn > bestn) {
+                best = r;
+                bestn = sn;
+            }
+        }
+
+        /* Separate from the previous strip */
+        if (n > 0) res[n++] = restart;
+
+        used[i] = -1;
+        res[n++] = v[best];
+        res[n++] = v[(best + 1) % 3];
+        res[n++] = v[(best + 2) % 3];
+        n += my_grow(edges, mask, idx, used, -1, v[(best + 1) % 3], v[(best + 2) % 3], 1, &res[n]);
+    }
+
+    ks_free(used);
+    ks_free(edges);
+
+    *nout = n;
+    return res;
+}
+
+
+/* Functions */
+
+static KS_TFUNC(M, stripify) {
+    kso idx;
+    ks_cint restart = 0xFFFFFFFF;
+    KS_ARGS("idx ?restart:cint", &idx, &restart);
+
+    ksgl_buf buf;
+    if (!ksgl_buf_getas(idx, nxd_u32, &buf)) {
+        return NULL;
+    }
+
+    ks_size_t n = buf.len / sizeof(nx_u32);
+    if (n % 3 != 0) {
+        KS_THROW(kst_SizeError, "Expected a list of triangles, but got %i indices (which is not a multiple of 3)", (int)n);
+        ksgl_buf_done(&buf);
+        return NULL;
+    }
+
+    ks_size_t nout;
+    nx_u32* strip = ksgl_stripify(buf.data, n / 3, restart, &nout);
+    ksgl_buf_done(&buf);
+    if (!strip) {
+        return NULL;
+    }
+
+    nx_array res = nx_array_newc(nxt_array, strip, nxd_u32, 1, (ks_size_t[]){ nout }, NULL);
+    ks_free(strip);
+    return (kso)res;
+}
 
 
 /* Export */
@@ -17,7 +178,9 @@ ks_module _ksgl_util() {
         /* Types */
 
         /* Functions */
-
+        {"stripify",               ksf_wrap(M_stripify_, "gl.util.stripify(idx, restart=0xFFFFFFFF)", "Converts indexed triangles (with consistent winding) into triangle strips, which are separated by 'restart' (the primitive restart index). The result is a 1D array of 'nx.u32', to be drawn with 'gl.TRIANGLE_STRIP' after 'gl.primitive_restart(restart)'. 'gl.EBO(idx, strip=true)' does all of this itself")},
 
     ));
+
+    return res;
 }
@@ -9,38 +9,256 @@
 
 /* Internals */
 
+/* Set attributes 'base' through 'base+nattr-1' to read from 'buf', which holds 'n' vertices (or instances, if 'inst'),
+ *   or unset them if 'n < 0'. Then, the counts and the list of attached buffers are recomputed from every attribute
+ */
+static void my_setattrs(ksgl_vao self, int base, int nattr, kso buf, ks_cint n, bool inst) {
+    int i, j;
+    for (i = base; i < base + nattr && i < KSGL_MAXATTRIB; ++i) {
+        if (i < 0) continue;
+        self->attrs[i].buf = n >= 0 ? buf : NULL;
+        self->attrs[i].n = n;
+        self->attrs[i].inst = inst;
+    }
+
+    /* Only as many vertices (or instances) as every buffer has can be drawn */
+    self->nvert = self->ninst = -1;
+    ks_list bufs = ks_list_new(0, NULL);
+    for (i = 0; i < KSGL_MAXATTRIB; ++i) {
+        struct ksgl_vaoattr* a = &self->attrs[i];
+        if (a->n < 0) continue;
+
+        ks_cint* cnt = a->inst ? &self->ninst : &self->nvert;
+        if (*cnt < 0 || a->n < *cnt) *cnt = a->n;
+
+        if (a->buf) {
+            for (j = 0; j < bufs->len && bufs->elems[j] != a->buf; ++j);
+            if (j == bufs->len) ks_list_push(bufs, a->buf);
+        }
+    }
+
+    /* Buffers which are no longer used are released */
+    KS_DECREF(self->bufs);
+    self->bufs = bufs;
+}
+
+
 /* C-API */
 
+bool ksgl_vao_attach(ksgl_vao self, kso vbo, ksgl_vertexlayout layout, int base, ks_size_t offset, int divisor) {
+    int val;
+    ks_size_t off, size;
+    if (!ksgl_getbuffer(vbo, &val, &off, &size)) {
+        return false;
+    }
+
+    if (!ksgl_vertexlayout_apply(layout, self->val, val, base, off + offset, divisor)) {
+        return false;
+    }
+
+    ks_cint n = layout->stride > 0 && size > offset ? (size - offset) / layout->stride : 0;
+    if (divisor > 0) n *= divisor;
+    my_setattrs(self, base, layout->nattr, vbo, n, divisor > 0);
+
+    return true;
+}
+
+bool ksgl_vao_draw(ksgl_vao self, ks_cint instances) {
+    /* Default to every instance that has been attached */
+    if (instances < 0) instances = self->ninst >= 0 ? self->ninst : 1;
+
+    /* Total number of indices (or vertices) available */
+    ks_cint total;
+    if (self->ebo) {
+        total = self->ebo->num;
+    } else if (self->nvert >= 0) {
+        total = self->nvert;
+    } else {
+        KS_THROW(kst_Error, "Nothing to draw (use 'attach()' to add a vertex buffer)");
+        return false;
+    }
+
+    ks_cint num = self->count < 0 ? total - self->first : self->count;
+    if (self->first + num > total) {
+        KS_THROW(kst_SizeError, "Drawing %i elements starting at %i is out of range for %i elements", (int)num, (int)self->first, (int)total);
+        return false;
+    }
+    if (num <= 0 || instances <= 0) {
+        return true;
+    }
+
+    /* Bind, unless it is already bound (i.e. the same VAO is drawn repeatedly) */
+    ksgl_ctx_bindvao(self->val, true);
+
+    if (self->ebo) {
+        void* offset = (void*)(self->first * ksgl_idxsize(self->ebo->idxtype));
+        if (self->ebo->strip) {
+            ksgl_ctx_restart(ksgl_idxrestart(self->ebo->idxtype));
+        } else {
+            ksgl_ctx_norestart();
+        }
+        if (instances == 1) {
+            glDrawElements(self->mode, num, self->ebo->idxtype, offset);
+        } else {
+            glDrawElementsInstanced(self->mode, num, self->ebo->idxtype, offset, instances);
+        }
+    } else {
+        if (instances == 1) {
+            glDrawArrays(self->mode, self->first, num);
+        } else {
+            glDrawArraysInstanced(self->mode, self->first, num, instances);
+        }
+    }
+
+    return true;
+}
+
 /* Type Functions */
 
 static KS_TFUNC(T, free) {
     ksgl_vao self;
     KS_ARGS("self:*", &self, ksglt_vao);
 
-    if (self->val >= 0) glDeleteVertexArrays(1, (GLuint[]){ self->val });
+    if (self->val >= 0) ksgl_ctx_release(KSGL_OBJ_VAO, self->val, NULL);
+    if (self->mats >= 0) ksgl_ctx_release(KSGL_OBJ_BUFFER, self->mats, (ks_size_t[]){ self->mats_size, GL_DYNAMIC_DRAW, 0 });
+
+    KS_NDECREF(self->bufs);
+    KS_NDECREF(self->ebo);
 
     KSO_DEL(self);
     return KSO_NONE;
 }
 
+/* Attach element buffer 'ebo' (or detach, if it is NULL) */
+static bool my_attach_ebo(ksgl_vao self, ksgl_ebo ebo) {
+    ksgl_ctx_bindvao(self->val, false);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo ? ebo->val : 0);
+    if (!ksgl_check()) {
+        return false;
+    }
+
+    /* Strips from 'gl.EBO(..., strip=true)' can't be drawn as a list of triangles (and a list of triangles
+     *   replacing them can't be drawn as strips)
+     */
+    if (ebo && ebo->strip) {
+        self->mode = GL_TRIANGLE_STRIP;
+    } else if (self->ebo && self->ebo->strip && self->mode == GL_TRIANGLE_STRIP) {
+        self->mode = GL_TRIANGLES;
+    }
+
+    if (ebo) KS_INCREF(ebo);
+    KS_NDECREF(self->ebo);
+    self->ebo = ebo;
+    return true;
+}
 
 static KS_TFUNC(T, init) {
     ksgl_vao self;
-    KS_ARGS("self:*", &self, ksglt_vao);
+    kso vbo = KSO_NONE, layout = KSO_NONE, ebo = KSO_NONE;
+    ks_cint mode = GL_TRIANGLES;
+    KS_ARGS("self:* ?vbo ?layout ?ebo ?mode:cint", &self, ksglt_vao, &vbo, &layout, &ebo, &mode);
+
+    /* Create vertex array object */
+    self->val = ksgl_ctx_gen(KSGL_OBJ_VAO);
+
+    self->bufs = ks_list_new(0, NULL);
+    self->ebo = NULL;
+    self->mode = mode;
+    self->first = 0;
+    self->count = -1;
+    self->nvert = -1;
+    self->ninst = -1;
+    self->mats = -1;
+    self->mats_size = 0;
+
+    int i;
+    for (i = 0; i < KSGL_MAXATTRIB; ++i) {
+        self->attrs[i].buf = NULL;
+        self->attrs[i].n = -1;
+        self->attrs[i].inst = false;
+    }
 
-    /* Create buffer object */
-    GLuint t;
-    glGenVertexArrays(1, &t);
-    self->val = t;
+    if (vbo != KSO_NONE) {
+        if (!kso_issub(layout->type, ksglt_vertexlayout)) {
+            KS_THROW(kst_TypeError, "Expected 'layout' to be a '%S', but got '%T'", ksglt_vertexlayout, layout);
+            return NULL;
+        }
+        if (!ksgl_vao_attach(self, vbo, (ksgl_vertexlayout)layout, 0, 0, 0)) {
+            return NULL;
+        }
+    }
+
+    if (ebo != KSO_NONE) {
+        if (!kso_issub(ebo->type, ksglt_ebo)) {
+            KS_THROW(kst_TypeError, "Expected 'ebo' to be a '%S', but got '%T'", ksglt_ebo, ebo);
+            return NULL;
+        }
+        if (!my_attach_ebo(self, (ksgl_ebo)ebo)) {
+            return NULL;
+        }
+    }
 
     return KSO_NONE;
 }
 
+static KS_TFUNC(T, getattr) {
+    ksgl_vao self;
+    ks_str attr;
+    KS_ARGS("self:* attr:*", &self, ksglt_vao, &attr, kst_str);
+
+    if (ks_str_eq_c(attr, "bufs", 4)) {
+        return KS_NEWREF(self->bufs);
+    } else if (ks_str_eq_c(attr, "ebo", 3)) {
+        return self->ebo ? KS_NEWREF(self->ebo) : KSO_NONE;
+    } else if (ks_str_eq_c(attr, "mode", 4)) {
+        return (kso)ks_int_new(self->mode);
+    } else if (ks_str_eq_c(attr, "first", 5)) {
+        return (kso)ks_int_new(self->first);
+    } else if (ks_str_eq_c(attr, "count", 5)) {
+        return (kso)ks_int_new(self->count);
+    } else if (ks_str_eq_c(attr, "nvert", 5)) {
+        return (kso)ks_int_new(self->nvert);
+    } else if (ks_str_eq_c(attr, "ninst", 5)) {
+        return (kso)ks_int_new(self->ninst);
+    }
+
+    KS_THROW_ATTR(self, attr);
+    return NULL;
+}
+
+static KS_TFUNC(T, setattr) {
+    ksgl_vao self;
+    ks_str attr;
+    kso val;
+    KS_ARGS("self:* attr:* val", &self, ksglt_vao, &attr, kst_str, &val);
+
+    ks_cint v;
+    if (ks_str_eq_c(attr, "mode", 4)) {
+        if (!kso_get_ci(val, &v)) return NULL;
+        self->mode = v;
+    } else if (ks_str_eq_c(attr, "first", 5)) {
+        if (!kso_get_ci(val, &v)) return NULL;
+        if (v < 0) {
+            KS_THROW(kst_SizeError, "'first' must not be negative");
+            return NULL;
+        }
+        self->first = v;
+    } else if (ks_str_eq_c(attr, "count", 5)) {
+        if (!kso_get_ci(val, &v)) return NULL;
+        self->count = v;
+    } else {
+        KS_THROW_ATTR(self, attr);
+        return NULL;
+    }
+
+    return KS_NEWREF(val);
+}
+
 static KS_TFUNC(T, bind) {
     ksgl_vao self;
     KS_ARGS("self:*", &self, ksglt_vao);
 
-    glBindVertexArray(self->val);
+    ksgl_ctx_bindvao(self->val, false);
     if (!ksgl_check()) {
         return NULL;
     }
@@ -51,13 +269,157 @@ static KS_TFUNC(T, unbind) {
     ksgl_vao self;
     KS_ARGS("self:*", &self, ksglt_vao);
 
-    glBindVertexArray(0);
+    ksgl_ctx_bindvao(0, false);
     if (!ksgl_check()) {
         return NULL;
     }
     return KSO_NONE;
 }
 
+static KS_TFUNC(T, attach) {
+    ksgl_vao self;
+    kso vbo;
+    ksgl_vertexlayout layout;
+    ks_cint base = 0, divisor = 0;
+    KS_ARGS("self:* vbo layout:* ?base:cint ?divisor:cint", &self, ksglt_vao, &vbo, &layout, ksglt_vertexlayout, &base, &divisor);
+
+    if (divisor < 0) {
+        KS_THROW(kst_SizeError, "'divisor' must not be negative");
+        return NULL;
+    }
+
+    if (!ksgl_vao_attach(self, vbo, layout, base, 0, divisor)) {
+        return NULL;
+    }
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, attach_ebo) {
+    ksgl_vao self;
+    kso ebo;
+    KS_ARGS("self:* ebo", &self, ksglt_vao, &ebo);
+
+    if (ebo != KSO_NONE && !kso_issub(ebo->type, ksglt_ebo)) {
+        KS_THROW(kst_TypeError, "Expected 'ebo' to be a '%S' or none, but got '%T'", ksglt_ebo, ebo);
+        return NULL;
+    }
+
+    if (!my_attach_ebo(self, ebo == KSO_NONE ? NULL : (ksgl_ebo)ebo)) {
+        return NULL;
+    }
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, attach_matrices) {
+    ksgl_vao self;
+    kso mats;
+    ks_cint base;
+    KS_ARGS("self:* mats base:cint", &self, ksglt_vao, &mats, &base);
+
+    if (base < 0 || base + 4 > KSGL_MAXATTRIB) {
+        KS_THROW(kst_SizeError, "Attributes %i through %i are out of range (max: %i)", (int)base, (int)base + 3, KSGL_MAXATTRIB);
+        return NULL;
+    }
+
+    nx_t vn;
+    kso ref = NULL;
+    if (!nx_get(mats, nxd_F, &vn, &ref)) {
+        return NULL;
+    }
+    if (vn.rank != 3 || vn.shape[1] != 4 || vn.shape[2] != 4) {
+        KS_THROW(kst_SizeError, "Expected an array of shape (N, 4, 4) of matrices");
+        KS_NDECREF(ref);
+        return NULL;
+    }
+
+    /* Transpose each matrix while gathering, since 'mat4' attributes are read as columns */
+    ks_size_t n = vn.shape[0], sz = n * 16 * sizeof(GLfloat);
+    GLfloat* data = ks_malloc(sz);
+    if (!data && sz > 0) {
+        KS_THROW(kst_Error, "Failed to allocate data");
+        KS_NDECREF(ref);
+        return NULL;
+    }
+
+    ks_size_t k;
+    int i, j;
+    for (k = 0; k < n; ++k) {
+        for (i = 0; i < 4; ++i) {
+            for (j = 0; j < 4; ++j) {
+                data[16 * k + 4 * j + i] = *(nx_F*)((ks_uint)vn.data + vn.strides[0] * k + vn.strides[1] * i + vn.strides[2] * j);
+            }
+        }
+    }
+    KS_NDECREF(ref);
+
+    /* Reuse the buffer if it is the same size, since matrices are typically updated each frame */
+    if (self->mats < 0 || self->mats_size != sz) {
+        if (self->mats >= 0) ksgl_ctx_release(KSGL_OBJ_BUFFER, self->mats, (ks_size_t[]){ self->mats_size, GL_DYNAMIC_DRAW, 0 });
+
+        GLuint t;
+        if (ksgl_ctx_take(KSGL_OBJ_BUFFER, (ks_size_t[]){ sz, GL_DYNAMIC_DRAW, 0 }, &t)) {
+            self->mats = t;
+            ksgl_ctx_bindbuf(GL_ARRAY_BUFFER, self->mats);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, sz, data);
+        } else {
+            self->mats = ksgl_ctx_gen(KSGL_OBJ_BUFFER);
+            ksgl_ctx_bindbuf(GL_ARRAY_BUFFER, self->mats);
+            glBufferData(GL_ARRAY_BUFFER, sz, data, GL_DYNAMIC_DRAW);
+        }
+        self->mats_size = sz;
+    } else {
+        /* Orphan the old storage, so that draws still using it don't stall */
+        ksgl_ctx_bindbuf(GL_ARRAY_BUFFER, self->mats);
+        glBufferData(GL_ARRAY_BUFFER, sz, data, GL_DYNAMIC_DRAW);
+    }
+    ks_free(data);
+    ksgl_stats.n_upload++;
+    ksgl_stats.sz_upload += sz;
+    ksgl_stats.sz_upload_copied += sz;
+
+    /* Each matrix is 4 attributes (one per column), which advance once per instance */
+    ksgl_ctx_bindvao(self->val, false);
+    for (i = 0; i < 4; ++i) {
+        glVertexAttribPointer(base + i, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(GLfloat), (void*)(4 * sizeof(GLfloat) * i));
+        glVertexAttribDivisor(base + i, 1);
+        glEnableVertexAttribArray(base + i);
+    }
+    if (!ksgl_check()) {
+        return NULL;
+    }
+
+    my_setattrs(self, base, 4, NULL, n, true);
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, attrib_divisor) {
+    ksgl_vao self;
+    ks_cint index, divisor;
+    KS_ARGS("self:* index:cint divisor:cint", &self, ksglt_vao, &index, &divisor);
+
+    ksgl_ctx_bindvao(self->val, false);
+    glVertexAttribDivisor(index, divisor);
+    if (!ksgl_check()) {
+        return NULL;
+    }
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, draw) {
+    ksgl_vao self;
+    ks_cint instances = -1;
+    KS_ARGS("self:* ?instances:cint", &self, ksglt_vao, &instances);
+
+    if (!ksgl_vao_draw(self, instances)) {
+        return NULL;
+    }
+
+    return KSO_NONE;
+}
+
 static KS_TFUNC(T, attrib) {
     ksgl_vao self;
     ks_cint index, size, type, normalize, stride, offset = 0;
@@ -68,6 +430,9 @@ static KS_TFUNC(T, attrib) {
         return NULL;
     }
 
+    /* It no longer reads from a buffer which was attached */
+    my_setattrs(self, index, 1, NULL, -1, false);
+
     /* Enable by default */
     glEnableVertexAttribArray(index);
 
@@ -106,7 +471,9 @@ ks_type ksglt_vao;
 void _ksgl_vao() {
     ksglt_vao = ks_type_new(T_NAME, kst_object, sizeof(struct ksgl_vao_s), -1, "OpenGL vertex array object (vao)", KS_IKV(
         {"__free",                 ksf_wrap(T_free_, T_NAME ".__free(self)", "")},
-        {"__init",                 ksf_wrap(T_init_, T_NAME ".__init(self)", "")},
+        {"__init",                 ksf_wrap(T_init_, T_NAME ".__init(self, vbo=none, layout=none, ebo=none, mode=gl.TRIANGLES)", "Creates a vertex array object, optionally attaching 'vbo' (described by 'layout') and 'ebo', which are drawn with 'mode' by 'draw()'. If 'ebo' holds strips, the mode is 'gl.TRIANGLE_STRIP'")},
+        {"__getattr",              ksf_wrap(T_getattr_, T_NAME ".__getattr(self, attr)", "")},
+        {"__setattr",              ksf_wrap(T_setattr_, T_NAME ".__setattr(self, attr, val)", "")},
 
         {"bind",                   ksf_wrap(T_bind_, T_NAME ".bind(self)", "Bind this vertex array object as the current one")},
         {"unbind",                 ksf_wrap(T_unbind_, T_NAME ".unbind(self)", "Unbind this vertex array")},
@@ -115,6 +482,14 @@ void _ksgl_vao() {
 
         {"attrib_enable",          ksf_wrap(T_attrib_enable_, T_NAME ".attrib_enable(self, index)", "Enables a vertex attribute")},
         {"attrib_disable",         ksf_wrap(T_attrib_disable_, T_NAME ".attrib_disable(self, index)", "Disables a vertex attribute")},
+        {"attrib_divisor",         ksf_wrap(T_attrib_divisor_, T_NAME ".attrib_divisor(self, index, divisor)", "Sets the rate at which a vertex attribute advances during instanced draws (0: once per vertex, N: once per N instances)")},
+
+        {"attach",                 ksf_wrap(T_attach_, T_NAME ".attach(self, vbo, layout, base=0, divisor=0)", "Attaches a vertex buffer (a 'gl.VBO' or 'gl.ArenaAlloc') described by 'layout', whose attributes start at index 'base'. If 'divisor > 0', it holds per-instance attributes (see 'attrib_divisor()'). A reference is kept to 'vbo' until all of its attributes are replaced, and '.nvert' (or '.ninst') is recomputed from the buffers which are attached")},
+        {"attach_ebo",             ksf_wrap(T_attach_ebo_, T_NAME ".attach_ebo(self, ebo)", "Attaches an element buffer (or detaches it, if 'ebo' is none), which is used by 'draw()'. A reference is kept to 'ebo'")},
+
+        {"attach_matrices",        ksf_wrap(T_attach_matrices_, T_NAME ".attach_matrices(self, mats, base)", "Uploads an array of shape (N, 4, 4) as per-instance matrices, read by a 'mat4' attribute at location 'base' (which takes up 'base' through 'base+3'). Calling it again replaces the matrices, reusing the same buffer if N is unchanged")},
+
+        {"draw",                   ksf_wrap(T_draw_, T_NAME ".draw(self, instances=-1)", "Draws the primitives described by '.mode', '.first', and '.count' (default: all of them), using the element buffer if one is attached. If 'instances < 0', every attached instance is drawn (or 1, if none are attached). The VAO is left bound, so drawing it again does not rebind it")},
 
     ));
 }
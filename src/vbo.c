@@ -9,6 +9,50 @@
 
 /* Internals */
 
+/* Whether 'glInvalidateBufferSubData' is available (-1 if not checked yet) */
+static int my_has_invalidate = -1;
+
+/* Returns whether 'usage' is a hint for data that is frequently rewritten */
+static bool my_isdynamic(int usage) {
+    return usage == GL_STREAM_DRAW || usage == GL_STREAM_READ || usage == GL_STREAM_COPY
+        || usage == GL_DYNAMIC_DRAW || usage == GL_DYNAMIC_READ || usage == GL_DYNAMIC_COPY;
+}
+
+/* Invalidate, then write 'len' bytes at 'offset', assuming the buffer is bound to GL_ARRAY_BUFFER */
+static bool my_write_invalidate(ksgl_vbo self, ks_size_t offset, ks_size_t len, void* data) {
+    if (my_has_invalidate < 0) {
+        my_has_invalidate = ksgl_hasver(4, 3) || ksgl_hasext("GL_ARB_invalidate_subdata");
+    }
+
+    if (my_has_invalidate) {
+        glInvalidateBufferSubData(self->val, offset, len);
+        glBufferSubData(GL_ARRAY_BUFFER, offset, len, data);
+    } else {
+        /* Mapping with 'GL_MAP_INVALIDATE_RANGE_BIT' has the same effect in OpenGL 3.3 */
+        void* ptr = glMapBufferRange(GL_ARRAY_BUFFER, offset, len, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+        if (!ptr) {
+            return ksgl_check();
+        }
+        memcpy(ptr, data, len);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+
+    return ksgl_check();
+}
+
+/* Single range given to 'write_many()' */
+struct my_range {
+    ks_size_t offset;
+    ksgl_buf buf;
+};
+
+/* Compare ranges by offset */
+static int my_cmp_range(const void* A, const void* B) {
+    const struct my_range* a = A;
+    const struct my_range* b = B;
+    return a->offset < b->offset ? -1 : (a->offset > b->offset ? 1 : 0);
+}
+
 /* C-API */
 
 /* Type Functions */
@@ -17,7 +61,8 @@ static KS_TFUNC(T, free) {
     ksgl_vbo self;
     KS_ARGS("self:*", &self, ksglt_vbo);
 
-    if (self->val >= 0) glDeleteBuffers(1, (GLuint[]){ self->val });
+    /* Recycle the handle, since another buffer of the same size may be created soon */
+    if (self->val >= 0) ksgl_ctx_release(KSGL_OBJ_BUFFER, self->val, self->pool ? (ks_size_t[]){ self->size, self->usage, 0 } : NULL);
 
     KSO_DEL(self);
     return KSO_NONE;
@@ -32,27 +77,38 @@ static KS_TFUNC(T, init) {
     KS_ARGS("self:* ?data ?usage:cint", &self, ksglt_vbo, &data, &usage);
 
     self->val = -1;
+    self->size = 0;
+    self->usage = usage;
+    self->pool = true;
 
-    /* Create buffer object */
-    GLuint t;
-    glGenBuffers(1, &t);
-    self->val = t;
-    if (!ksgl_check()) {
+    /* Get the raw data (without copying, if possible) */
+    ksgl_buf buf;
+    if (!ksgl_buf_get(data, &buf)) {
         return NULL;
     }
 
-    /* Convert the data to its bytes equivalent */
-    ks_bytes data_bytes = kso_bytes(data);
-    if (!data_bytes) {
-        return NULL;
+    self->size = buf.len;
+
+    GLuint t;
+    if (ksgl_ctx_take(KSGL_OBJ_BUFFER, (ks_size_t[]){ self->size, self->usage, 0 }, &t)) {
+        /* Recycled buffer, which already has (new) storage of the right size */
+        self->val = t;
+        ksgl_ctx_bindbuf(GL_ARRAY_BUFFER, self->val);
+        if (buf.len > 0) glBufferSubData(GL_ARRAY_BUFFER, 0, buf.len, buf.data);
+    } else {
+        /* Create buffer object */
+        self->val = ksgl_ctx_gen(KSGL_OBJ_BUFFER);
+
+        /* Bind as the currently used buffer */
+        ksgl_ctx_bindbuf(GL_ARRAY_BUFFER, self->val);
+        glBufferData(GL_ARRAY_BUFFER, buf.len, buf.data, usage);
     }
 
-    /* Bind as the currently used buffer */
-    glBindBuffer(GL_ARRAY_BUFFER, self->val);
-    glBufferData(GL_ARRAY_BUFFER, data_bytes->len_b, data_bytes->data, usage);
+    /* Done with the data */
+    ksgl_buf_done(&buf);
 
-    /* Done with the bytes */
-    KS_DECREF(data_bytes);
+    /* It is left bound, so raw attribute pointers ('gl.VAO.attrib()') may refer to it */
+    self->pool = false;
 
     if (!ksgl_check()) {
         return NULL;
@@ -65,7 +121,9 @@ static KS_TFUNC(T, bind) {
     ksgl_vbo self;
     KS_ARGS("self:*", &self, ksglt_vbo);
 
-    glBindBuffer(GL_ARRAY_BUFFER, self->val);
+    /* Raw attribute pointers may now refer to this handle */
+    self->pool = false;
+    ksgl_ctx_bindbuf(GL_ARRAY_BUFFER, self->val);
     if (!ksgl_check()) {
         return NULL;
     }
@@ -77,7 +135,7 @@ static KS_TFUNC(T, unbind) {
     ksgl_vbo self;
     KS_ARGS("self:*", &self, ksglt_vbo);
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    ksgl_ctx_bindbuf(GL_ARRAY_BUFFER, 0);
     if (!ksgl_check()) {
         return NULL;
     }
@@ -86,27 +144,203 @@ static KS_TFUNC(T, unbind) {
 }
 
 
+static KS_TFUNC(T, getattr) {
+    ksgl_vbo self;
+    ks_str attr;
+    KS_ARGS("self:* attr:*", &self, ksglt_vbo, &attr, kst_str);
+
+    if (ks_str_eq_c(attr, "size", 4)) {
+        return (kso)ks_int_new(self->size);
+    } else if (ks_str_eq_c(attr, "usage", 5)) {
+        return (kso)ks_int_new(self->usage);
+    }
+
+    KS_THROW_ATTR(self, attr);
+    return NULL;
+}
+
+
 static KS_TFUNC(T, write) {
     ksgl_vbo self;
     kso data;
     ks_cint offset = 0;
-    KS_ARGS("self:* data ?offset:cint", &self, ksglt_vbo, &data, &offset);
+    ks_str mode = NULL;
+    KS_ARGS("self:* data ?offset:cint ?mode:*", &self, ksglt_vbo, &data, &offset, &mode, kst_str);
+
+    /* Get the raw data (without copying, if possible) */
+    ksgl_buf buf;
+    if (!ksgl_buf_get(data, &buf)) {
+        return NULL;
+    }
+
+    if (offset < 0 || offset + buf.len > self->size) {
+        KS_THROW(kst_SizeError, "Writing %i bytes at offset %i is out of range for a buffer of %i bytes", (int)buf.len, (int)offset, (int)self->size);
+        ksgl_buf_done(&buf);
+        return NULL;
+    }
+
+    /* Whether the entire buffer is being rewritten */
+    bool isfull = offset == 0 && buf.len == self->size;
+
+    /* Decide how to write */
+    enum {
+        MODE_SUB,
+        MODE_ORPHAN,
+        MODE_INVALIDATE,
+    } m;
+
+    if (!mode || ks_str_eq_c(mode, "auto", 4)) {
+        /* Orphan full rewrites of dynamic buffers, so they don't wait on draws using the old contents */
+        m = (isfull && my_isdynamic(self->usage)) ? MODE_ORPHAN : MODE_SUB;
+    } else if (ks_str_eq_c(mode, "sub", 3)) {
+        m = MODE_SUB;
+    } else if (ks_str_eq_c(mode, "orphan", 6)) {
+        m = MODE_ORPHAN;
+    } else if (ks_str_eq_c(mode, "invalidate", 10)) {
+        m = MODE_INVALIDATE;
+    } else {
+        KS_THROW(kst_Error, "Unknown write mode %R (expected 'auto', 'sub', 'orphan', or 'invalidate')", mode);
+        ksgl_buf_done(&buf);
+        return NULL;
+    }
 
     /* Bind for writing */
-    glBindBuffer(GL_ARRAY_BUFFER, self->val);
+    ksgl_ctx_bindbuf(GL_ARRAY_BUFFER, self->val);
     if (!ksgl_check()) {
+        ksgl_buf_done(&buf);
         return NULL;
     }
 
-    /* Convert the data to its bytes equivalent */
-    ks_bytes data_bytes = kso_bytes(data);
-    if (!data_bytes) {
+    bool ok = true;
+    if (m == MODE_ORPHAN) {
+        if (isfull) {
+            /* Re-specifying with the data orphans the old storage and writes in one call */
+            glBufferData(GL_ARRAY_BUFFER, self->size, buf.data, self->usage);
+        } else {
+            /* Orphan the old storage, then write (the rest of the contents are undefined) */
+            glBufferData(GL_ARRAY_BUFFER, self->size, NULL, self->usage);
+            glBufferSubData(GL_ARRAY_BUFFER, offset, buf.len, buf.data);
+        }
+        ok = ksgl_check();
+    } else if (m == MODE_INVALIDATE) {
+        ok = my_write_invalidate(self, offset, buf.len, buf.data);
+    } else {
+        glBufferSubData(GL_ARRAY_BUFFER, offset, buf.len, buf.data);
+        ok = ksgl_check();
+    }
+
+    ksgl_buf_done(&buf);
+    if (!ok) {
         return NULL;
     }
 
-    glBufferSubData(GL_ARRAY_BUFFER, offset, data_bytes->len_b, data_bytes->data);
-    KS_DECREF(data_bytes);
-    if (!ksgl_check()) {
+    return KSO_NONE;
+}
+
+
+static KS_TFUNC(T, write_many) {
+    ksgl_vbo self;
+    kso ranges;
+    KS_ARGS("self:* ranges", &self, ksglt_vbo, &ranges);
+
+    ks_list lr = ks_list_newi(ranges);
+    if (!lr) {
+        return NULL;
+    }
+
+    int n = lr->len;
+    struct my_range* rs = ks_zmalloc(sizeof(*rs), n > 0 ? n : 1);
+
+    /* Number of ranges which have been converted */
+    int i, nr = 0;
+    bool ok = true;
+    for (i = 0; i < n && ok; ++i) {
+        kso it = lr->elems[i];
+        kso* elems = NULL;
+        if (kso_issub(it->type, kst_tuple) && ((ks_tuple)it)->len == 2) {
+            elems = ((ks_tuple)it)->elems;
+        } else if (kso_issub(it->type, kst_list) && ((ks_list)it)->len == 2) {
+            elems = ((ks_list)it)->elems;
+        } else {
+            KS_THROW(kst_TypeError, "Expected each range to be a pair of '(offset, data)', but got '%T'", it);
+            ok = false;
+            break;
+        }
+
+        ks_cint offset;
+        if (!kso_get_ci(elems[0], &offset) || !ksgl_buf_get(elems[1], &rs[nr].buf)) {
+            ok = false;
+            break;
+        }
+        rs[nr].offset = offset;
+
+        if (offset < 0 || offset + rs[nr].buf.len > self->size) {
+            KS_THROW(kst_SizeError, "Writing %i bytes at offset %i is out of range for a buffer of %i bytes", (int)rs[nr].buf.len, (int)offset, (int)self->size);
+            ok = false;
+        }
+
+        if (ok && rs[nr].buf.len == 0) {
+            /* Empty writes do nothing (and would give empty spans, which can't be mapped) */
+            ksgl_buf_done(&rs[nr].buf);
+        } else {
+            nr++;
+        }
+    }
+    KS_DECREF(lr);
+
+    if (ok) {
+        qsort(rs, nr, sizeof(*rs), my_cmp_range);
+        for (i = 1; i < nr; ++i) {
+            if (rs[i - 1].offset + rs[i - 1].buf.len > rs[i].offset) {
+                KS_THROW(kst_Error, "Ranges at offsets %i and %i overlap", (int)rs[i - 1].offset, (int)rs[i].offset);
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    if (ok && nr > 0) {
+        /* Bind once for all writes */
+        ksgl_ctx_bindbuf(GL_ARRAY_BUFFER, self->val);
+
+        i = 0;
+        while (i < nr) {
+            /* Find the span of adjacent ranges */
+            int j = i + 1;
+            ks_size_t end = rs[i].offset + rs[i].buf.len;
+            while (j < nr && rs[j].offset == end) {
+                end += rs[j].buf.len;
+                j++;
+            }
+
+            if (j - i == 1) {
+                glBufferSubData(GL_ARRAY_BUFFER, rs[i].offset, rs[i].buf.len, rs[i].buf.data);
+            } else {
+                /* Since the span is completely overwritten, it can be invalidated and written through a mapping */
+                void* ptr = glMapBufferRange(GL_ARRAY_BUFFER, rs[i].offset, end - rs[i].offset, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+                if (!ptr) {
+                    break;
+                }
+
+                int k;
+                for (k = i; k < j; ++k) {
+                    memcpy((void*)((ks_uint)ptr + rs[k].offset - rs[i].offset), rs[k].buf.data, rs[k].buf.len);
+                }
+                glUnmapBuffer(GL_ARRAY_BUFFER);
+            }
+
+            i = j;
+        }
+
+        ok = ksgl_check();
+    }
+
+    for (i = 0; i < nr; ++i) {
+        ksgl_buf_done(&rs[i].buf);
+    }
+    ks_free(rs);
+
+    if (!ok) {
         return NULL;
     }
 
@@ -121,16 +355,14 @@ static KS_TFUNC(T, read) {
     KS_ARGS("self:* sz:cint ?offset:cint", &self, ksglt_vbo, &sz, &offset);
 
     /* Bind for writing */
-    glBindBuffer(GL_ARRAY_BUFFER, self->val);
+    ksgl_ctx_bindbuf(GL_ARRAY_BUFFER, self->val);
     if (!ksgl_check()) {
         return NULL;
     }
 
     if (sz < 0) {
         /* Calculate size*/
-        GLint tsz = 0;
-        glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &tsz);
-        sz = tsz - offset;
+        sz = (ks_cint)self->size - offset;
         if (sz < 0) sz = 0;
     }
 
@@ -149,6 +381,155 @@ static KS_TFUNC(T, read) {
     return (kso)ks_bytes_newn(sz, data);
 }
 
+static KS_TFUNC(T, read_into) {
+    ksgl_vbo self;
+    kso out;
+    ks_cint offset = 0;
+    KS_ARGS("self:* out ?offset:cint", &self, ksglt_vbo, &out, &offset);
+
+    nx_t val;
+    if (!ksgl_getnx(out, &val)) {
+        return NULL;
+    }
+
+    ks_size_t len = ksgl_nbytes(val);
+    if (offset < 0 || offset + len > self->size) {
+        KS_THROW(kst_SizeError, "Reading %i bytes at offset %i is out of range for a buffer of %i bytes", (int)len, (int)offset, (int)self->size);
+        return NULL;
+    }
+
+    /* Bind to the copy target, so that we don't disturb the array buffer binding */
+    glBindBuffer(GL_COPY_READ_BUFFER, self->val);
+    if (!ksgl_read_into(GL_COPY_READ_BUFFER, offset, val)) {
+        return NULL;
+    }
+
+    return KS_NEWREF(out);
+}
+
+static KS_TFUNC(T, read_async) {
+    ksgl_vbo self;
+    ks_cint sz = -1;
+    ks_cint offset = 0;
+    ksgl_asyncread handle = NULL;
+    KS_ARGS("self:* ?sz:cint ?offset:cint ?handle:*", &self, ksglt_vbo, &sz, &offset, &handle, ksglt_asyncread);
+
+    if (sz < 0) {
+        sz = (ks_cint)self->size - offset;
+        if (sz < 0) sz = 0;
+    }
+    if (offset < 0 || offset + sz > self->size) {
+        KS_THROW(kst_SizeError, "Reading %i bytes at offset %i is out of range for a buffer of %i bytes", (int)sz, (int)offset, (int)self->size);
+        return NULL;
+    }
+
+    return (kso)ksgl_asyncread_start(self->val, offset, sz, handle);
+}
+
+static KS_TFUNC(T, copy_from) {
+    ksgl_vbo self, src;
+    ks_cint src_off = 0, dst_off = 0, size = -1;
+    KS_ARGS("self:* src:* ?src_off:cint ?dst_off:cint ?size:cint", &self, ksglt_vbo, &src, ksglt_vbo, &src_off, &dst_off, &size);
+
+    if (size < 0) {
+        size = (ks_cint)src->size - src_off;
+        if (size < 0) size = 0;
+    }
+    if (src_off < 0 || src_off + size > src->size) {
+        KS_THROW(kst_SizeError, "Copying %i bytes from offset %i is out of range for a source buffer of %i bytes", (int)size, (int)src_off, (int)src->size);
+        return NULL;
+    }
+    if (dst_off < 0 || dst_off + size > self->size) {
+        KS_THROW(kst_SizeError, "Copying %i bytes to offset %i is out of range for a buffer of %i bytes", (int)size, (int)dst_off, (int)self->size);
+        return NULL;
+    }
+    if (src == self && src_off < dst_off + size && dst_off < src_off + size) {
+        KS_THROW(kst_Error, "Source and destination ranges overlap");
+        return NULL;
+    }
+
+    /* Copy on the GPU */
+    glBindBuffer(GL_COPY_READ_BUFFER, src->val);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, self->val);
+    if (size > 0) glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, src_off, dst_off, size);
+    if (!ksgl_check()) {
+        return NULL;
+    }
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, resize) {
+    ksgl_vbo self;
+    ks_cint new_size;
+    bool preserve = true;
+    KS_ARGS("self:* new_size:cint ?preserve:bool", &self, ksglt_vbo, &new_size, &preserve);
+
+    if (new_size < 0) {
+        KS_THROW(kst_SizeError, "'new_size' must not be negative, but got %i", (int)new_size);
+        return NULL;
+    }
+
+    /* Number of bytes to keep */
+    ks_size_t keep = preserve ? (new_size < self->size ? new_size : self->size) : 0;
+
+    /* Stash the contents in a temporary buffer on the GPU, since the storage is about to be re-specified
+     * (this keeps the same handle, so VAOs that reference this buffer are still valid)
+     */
+    GLuint tmp = 0;
+    if (keep > 0) {
+        glGenBuffers(1, &tmp);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, tmp);
+        glBufferData(GL_COPY_WRITE_BUFFER, keep, NULL, GL_STREAM_COPY);
+        glBindBuffer(GL_COPY_READ_BUFFER, self->val);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, keep);
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, self->val);
+    glBufferData(GL_COPY_WRITE_BUFFER, new_size, NULL, self->usage);
+
+    if (keep > 0) {
+        glBindBuffer(GL_COPY_READ_BUFFER, tmp);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, keep);
+        glDeleteBuffers(1, &tmp);
+    }
+    if (!ksgl_check()) {
+        return NULL;
+    }
+
+    self->size = new_size;
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, clone) {
+    ksgl_vbo self;
+    KS_ARGS("self:*", &self, ksglt_vbo);
+
+    ksgl_vbo res = KSO_NEW(ksgl_vbo, ksglt_vbo);
+    res->size = self->size;
+    res->usage = self->usage;
+    res->pool = true;
+
+    GLuint t;
+    if (ksgl_ctx_take(KSGL_OBJ_BUFFER, (ks_size_t[]){ res->size, res->usage, 0 }, &t)) {
+        res->val = t;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, res->val);
+    } else {
+        res->val = ksgl_ctx_gen(KSGL_OBJ_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, res->val);
+        glBufferData(GL_COPY_WRITE_BUFFER, res->size, NULL, res->usage);
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, self->val);
+    if (res->size > 0) glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, res->size);
+    if (!ksgl_check()) {
+        KS_DECREF(res);
+        return NULL;
+    }
+
+    return (kso)res;
+}
+
 /* Export */
 
 ks_type ksglt_vbo;
@@ -157,13 +538,21 @@ void _ksgl_vbo() {
     ksglt_vbo = ks_type_new(T_NAME, kst_object, sizeof(struct ksgl_vbo_s), -1, "OpenGL vertex buffer object (VBO)", KS_IKV(
         {"__free",                 ksf_wrap(T_free_, T_NAME ".__free(self)", "")},
         {"__init",                 ksf_wrap(T_init_, T_NAME ".__init(self, data='', usage=gl.STATIC_DRAW)", "")},
+        {"__getattr",              ksf_wrap(T_getattr_, T_NAME ".__getattr(self, attr)", "")},
 
         {"bind",                   ksf_wrap(T_bind_, T_NAME ".bind(self)", "Bind this vertex buffer object as the current one")},
         {"unbind",                 ksf_wrap(T_unbind_, T_NAME ".unbind(self)", "Unbind this vertex buffer object")},
 
+        {"write_many",             ksf_wrap(T_write_many_, T_NAME ".write_many(self, ranges)", "Writes many '(offset, data)' pairs at once, binding once and coalescing adjacent ranges into a single upload")},
+
         {"read",                   ksf_wrap(T_read_, T_NAME ".read(self, sz=-1, offset=0)", "Reads part of the buffer (default: all of the buffer), and returns a bytes object")},
-        {"write",                  ksf_wrap(T_write_, T_NAME ".write(self, data, offset=0)", "Writes a bytes-like object to the buffer at the given offset (default: beginning)")},
+        {"read_into",              ksf_wrap(T_read_into_, T_NAME ".read_into(self, out, offset=0)", "Reads part of the buffer (starting at 'offset') into an existing array 'out', without allocating if it is dense. Returns 'out'")},
+        {"read_async",             ksf_wrap(T_read_async_, T_NAME ".read_async(self, sz=-1, offset=0, handle=none)", "Starts reading part of the buffer without stalling, and returns a 'gl.AsyncRead' to collect the data later. If 'handle' is given, its staging storage is reused")},
+        {"write",                  ksf_wrap(T_write_, T_NAME ".write(self, data, offset=0, mode='auto')", "Writes a bytes-like object to the buffer at the given offset (default: beginning)\n\n'mode' can be 'sub' (plain update), 'orphan' (re-specify the storage first, which leaves the rest of the buffer undefined), 'invalidate' (invalidate just the written range first), or 'auto' (orphan full rewrites of 'STREAM_*' and 'DYNAMIC_*' buffers, otherwise 'sub')")},
 
+        {"copy_from",              ksf_wrap(T_copy_from_, T_NAME ".copy_from(self, src, src_off=0, dst_off=0, size=-1)", "Copies 'size' bytes (default: the rest of 'src') from another buffer, entirely on the GPU")},
+        {"resize",                 ksf_wrap(T_resize_, T_NAME ".resize(self, new_size, preserve=true)", "Resizes the buffer's storage, keeping the existing contents (on the GPU) if 'preserve' is true. The handle stays the same, so VAOs using this buffer stay valid")},
+        {"clone",                  ksf_wrap(T_clone_, T_NAME ".clone(self)", "Returns a new buffer with a copy of this buffer's contents, copied on the GPU")},
 
     ));
 }
@@ -0,0 +1,275 @@
+/* vertexlayout.c - gl.VertexLayout type
+ *
+ * @author: Cade Brown <cade@kscript.org>
+ */
+#include <ksgl.h>
+
+#define T_NAME M_NAME ".VertexLayout"
+
+
+/* Internals */
+
+/* Get the OpenGL type of components of 'dtype', or 0 if there is none */
+static GLenum my_gltype(nx_dtype dtype) {
+    if (dtype == nxd_F) {
+        return GL_FLOAT;
+    } else if (dtype == nxd_D) {
+        return GL_DOUBLE;
+    } else if (dtype == nxd_s8) {
+        return GL_BYTE;
+    } else if (dtype == nxd_u8) {
+        return GL_UNSIGNED_BYTE;
+    } else if (dtype == nxd_s16) {
+        return GL_SHORT;
+    } else if (dtype == nxd_u16) {
+        return GL_UNSIGNED_SHORT;
+    } else if (dtype == nxd_s32) {
+        return GL_INT;
+    } else if (dtype == nxd_u32) {
+        return GL_UNSIGNED_INT;
+    }
+
+    return 0;
+}
+
+/* Add an attribute of 'size' components of 'dtype' to the end of 'self' */
+static bool my_add(ksgl_vertexlayout self, ks_cint size, nx_dtype dtype, bool normalize, bool integer) {
+    if (self->nattr >= KSGL_MAXATTRIB) {
+        KS_THROW(kst_SizeError, "Too many attributes (max: %i)", KSGL_MAXATTRIB);
+        return false;
+    }
+    if (size < 1 || size > 4) {
+        KS_THROW(kst_SizeError, "Attributes must have 1 through 4 components, but got %i", (int)size);
+        return false;
+    }
+
+    GLenum type = my_gltype(dtype);
+    if (type == 0) {
+        KS_THROW(kst_TypeError, "Unsupported attribute type: %R", dtype);
+        return false;
+    }
+    if (integer && (type == GL_FLOAT || type == GL_DOUBLE || normalize)) {
+        KS_THROW(kst_TypeError, "Only integer attributes which aren't normalized can be given to integer inputs, but got %R", dtype);
+        return false;
+    }
+
+    struct ksgl_vertexattr* a = &self->attr[self->nattr++];
+    a->size = size;
+    a->type = type;
+    a->normalize = normalize;
+    a->integer = integer;
+    a->offset = self->stride;
+
+    self->stride += size * dtype->size;
+    return true;
+}
+
+/* Add an attribute from an entry of a description, which is either the number of components (of 'dtype'),
+ *   or a tuple of '(size, dtype, normalize=false, integer=false)'
+ */
+static bool my_addentry(ksgl_vertexlayout self, kso ent, nx_dtype dtype) {
+    ks_cint size;
+    if (kso_is_int(ent)) {
+        if (!kso_get_ci(ent, &size)) {
+            return false;
+        }
+        return my_add(self, size, dtype, false, false);
+    }
+
+    ks_list lv = ks_list_newi(ent);
+    if (!lv) {
+        return false;
+    }
+    if (lv->len < 2 || lv->len > 4) {
+        KS_THROW(kst_Error, "Attributes should be 'size' or '(size, dtype, normalize=false, integer=false)', but got %R", ent);
+        KS_DECREF(lv);
+        return false;
+    }
+
+    if (!kso_get_ci(lv->elems[0], &size)) {
+        KS_DECREF(lv);
+        return false;
+    }
+    if (!kso_issub(lv->elems[1]->type, nxt_dtype)) {
+        KS_THROW(kst_TypeError, "Expected attribute type to be an 'nx.dtype', but got %R", lv->elems[1]);
+        KS_DECREF(lv);
+        return false;
+    }
+
+    bool normalize = false, integer = false;
+    if ((lv->len >= 3 && !kso_truthy(lv->elems[2], &normalize)) || (lv->len >= 4 && !kso_truthy(lv->elems[3], &integer))) {
+        KS_DECREF(lv);
+        return false;
+    }
+
+    bool res = my_add(self, size, (nx_dtype)lv->elems[1], normalize, integer);
+    KS_DECREF(lv);
+    return res;
+}
+
+
+/* C-API */
+
+bool ksgl_vertexlayout_apply(ksgl_vertexlayout layout, int vao, int vbo, int base, ks_size_t offset, int divisor) {
+    if (base < 0 || base + layout->nattr > KSGL_MAXATTRIB) {
+        KS_THROW(kst_SizeError, "Attributes %i through %i are out of range (max: %i)", base, base + layout->nattr - 1, KSGL_MAXATTRIB);
+        return false;
+    }
+
+    ksgl_ctx_bindvao(vao, false);
+    ksgl_ctx_bindbuf(GL_ARRAY_BUFFER, vbo);
+
+    int i;
+    for (i = 0; i < layout->nattr; ++i) {
+        struct ksgl_vertexattr* a = &layout->attr[i];
+        if (a->integer) {
+            glVertexAttribIPointer(base + i, a->size, a->type, layout->stride, (void*)(offset + a->offset));
+        } else {
+            glVertexAttribPointer(base + i, a->size, a->type, a->normalize, layout->stride, (void*)(offset + a->offset));
+        }
+        glVertexAttribDivisor(base + i, divisor);
+        glEnableVertexAttribArray(base + i);
+    }
+
+    return ksgl_check();
+}
+
+
+/* Type Functions */
+
+static KS_TFUNC(T, free) {
+    ksgl_vertexlayout self;
+    KS_ARGS("self:*", &self, ksglt_vertexlayout);
+
+    KSO_DEL(self);
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, init) {
+    ksgl_vertexlayout self;
+    kso desc, split = KSO_NONE;
+    nx_dtype dtype = nxd_F;
+    KS_ARGS("self:* desc ?split ?dtype:*", &self, ksglt_vertexlayout, &desc, &split, &dtype, nxt_dtype);
+
+    self->nattr = 0;
+    self->stride = 0;
+
+    if (kso_issub(desc->type, nxt_array) || kso_issub(desc->type, nxt_view)) {
+        /* Derive from the trailing dimension of the array, which is a single vertex */
+        nx_t val;
+        if (!ksgl_getnx(desc, &val)) {
+            return NULL;
+        }
+        if (val.rank < 1) {
+            KS_THROW(kst_SizeError, "Expected an array with at least 1 dimension");
+            return NULL;
+        }
+
+        ks_size_t n = val.shape[val.rank - 1];
+        if (split == KSO_NONE) {
+            if (!my_add(self, n, val.dtype, false, false)) {
+                return NULL;
+            }
+        } else {
+            ks_list lv = ks_list_newi(split);
+            if (!lv) {
+                return NULL;
+            }
+
+            int i;
+            for (i = 0; i < lv->len; ++i) {
+                ks_cint size;
+                if (!kso_get_ci(lv->elems[i], &size) || !my_add(self, size, val.dtype, false, false)) {
+                    KS_DECREF(lv);
+                    return NULL;
+                }
+            }
+            KS_DECREF(lv);
+        }
+
+        if (self->stride != n * val.dtype->size) {
+            KS_THROW(kst_SizeError, "Attributes have %i components in total, but the array has %i per vertex", (int)(self->stride / val.dtype->size), (int)n);
+            return NULL;
+        }
+    } else {
+        if (split != KSO_NONE) {
+            KS_THROW(kst_Error, "'split' is only valid when deriving a layout from an array");
+            return NULL;
+        }
+
+        ks_list lv = ks_list_newi(desc);
+        if (!lv) {
+            return NULL;
+        }
+
+        int i;
+        for (i = 0; i < lv->len; ++i) {
+            if (!my_addentry(self, lv->elems[i], dtype)) {
+                KS_DECREF(lv);
+                return NULL;
+            }
+        }
+        KS_DECREF(lv);
+    }
+
+    return KSO_NONE;
+}
+
+static KS_TFUNC(T, str) {
+    ksgl_vertexlayout self;
+    KS_ARGS("self:*", &self, ksglt_vertexlayout);
+
+    return (kso)ks_fmt("<%T nattr=%i, stride=%i>", self, self->nattr, (int)self->stride);
+}
+
+static KS_TFUNC(T, getattr) {
+    ksgl_vertexlayout self;
+    ks_str attr;
+    KS_ARGS("self:* attr:*", &self, ksglt_vertexlayout, &attr, kst_str);
+
+    if (ks_str_eq_c(attr, "stride", 6)) {
+        return (kso)ks_int_new(self->stride);
+    } else if (ks_str_eq_c(attr, "nattr", 5)) {
+        return (kso)ks_int_new(self->nattr);
+    }
+
+    KS_THROW_ATTR(self, attr);
+    return NULL;
+}
+
+static KS_TFUNC(T, apply) {
+    ksgl_vertexlayout self;
+    ksgl_vao vao;
+    kso vbo;
+    ks_cint base = 0, offset = 0, divisor = 0;
+    KS_ARGS("self:* vao:* vbo ?base:cint ?offset:cint ?divisor:cint", &self, ksglt_vertexlayout, &vao, ksglt_vao, &vbo, &base, &offset, &divisor);
+
+    if (divisor < 0) {
+        KS_THROW(kst_SizeError, "'divisor' must not be negative");
+        return NULL;
+    }
+
+    /* 'vao' keeps the buffer alive (and its handle from being recycled) while it uses it */
+    if (!ksgl_vao_attach(vao, vbo, self, base, offset, divisor)) {
+        return NULL;
+    }
+
+    return KSO_NONE;
+}
+
+
+/* Export */
+
+ks_type ksglt_vertexlayout;
+
+void _ksgl_vertexlayout() {
+    ksglt_vertexlayout = ks_type_new(T_NAME, kst_object, sizeof(struct ksgl_vertexlayout_s), -1, "Layout of interleaved vertex attributes, which can be applied to a VAO in a single call", KS_IKV(
+        {"__free",                 ksf_wrap(T_free_, T_NAME ".__free(self)", "")},
+        {"__init",                 ksf_wrap(T_init_, T_NAME ".__init(self, desc, split=none, dtype=nx.float)", "Creates a layout from 'desc', which is either a list of attributes (each of which is a number of components of 'dtype', or a tuple of '(size, dtype, normalize=false, integer=false)', where 'integer' gives integer components to integer inputs like 'ivec3' as-is), or an array of vertices, whose trailing dimension is split into attributes of sizes 'split' (default: a single attribute)")},
+        {"__str",                  ksf_wrap(T_str_, T_NAME ".__str(self)", "")},
+        {"__repr",                 ksf_wrap(T_str_, T_NAME ".__repr(self)", "")},
+        {"__getattr",              ksf_wrap(T_getattr_, T_NAME ".__getattr(self, attr)", "")},
+
+        {"apply",                  ksf_wrap(T_apply_, T_NAME ".apply(self, vao, vbo, base=0, offset=0, divisor=0)", "Sets and enables attributes 'base', 'base+1', ... of 'vao' to read from 'vbo' (a 'gl.VBO' or 'gl.ArenaAlloc'), starting at byte 'offset'. If 'divisor > 0', they are per-instance attributes which advance every 'divisor' instances. Leaves 'vao' bound")},
+    ));
+}